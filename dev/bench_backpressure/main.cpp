@@ -0,0 +1,334 @@
+/*
+ * A benchmark that shows the effect of backpressure.
+ *
+ * A producer sends messages faster than a consumer can handle them.
+ * Without backpressure the consumer's queue grows until the producer
+ * stops. With backpressure the size of the queue is kept between
+ * watermarks, so the memory held by pending messages stays flat.
+ *
+ * The memory is measured: instances of messages and the storage of
+ * the queue are allocated via counting allocators.
+ *
+ * Usage:
+ *
+ * bench_backpressure [messages [handling_time_us]]
+ */
+
+#include <demo/demand_queues.hpp>
+
+#include <custom_queue_disps/one_thread.hpp>
+
+#include <so_5/all.hpp>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <future>
+#include <iomanip>
+#include <iostream>
+#include <memory_resource>
+#include <new>
+#include <string_view>
+
+namespace bench
+{
+
+using clock_type = std::chrono::steady_clock;
+
+//
+// memory_counter_t
+//
+// Counts bytes that are allocated at the moment and remembers the peak.
+//
+// Allocations and deallocations are made by different threads.
+//
+class memory_counter_t
+   {
+      std::atomic< std::size_t > m_current{};
+      std::atomic< std::size_t > m_peak{};
+
+   public:
+      void
+      allocated( std::size_t bytes ) noexcept
+         {
+            const auto current = bytes +
+                  m_current.fetch_add( bytes, std::memory_order_relaxed );
+
+            auto peak = m_peak.load( std::memory_order_relaxed );
+            while( current > peak &&
+                  !m_peak.compare_exchange_weak(
+                        peak, current, std::memory_order_relaxed ) )
+               {}
+         }
+
+      void
+      deallocated( std::size_t bytes ) noexcept
+         {
+            m_current.fetch_sub( bytes, std::memory_order_relaxed );
+         }
+
+      [[nodiscard]]
+      std::size_t
+      peak() const noexcept { return m_peak.load( std::memory_order_relaxed ); }
+
+      // Starts a new measurement. The current value isn't changed
+      // because some memory can still be held.
+      void
+      reset_peak() noexcept
+         {
+            m_peak.store(
+                  m_current.load( std::memory_order_relaxed ),
+                  std::memory_order_relaxed );
+         }
+   };
+
+// Memory held by pending messages: instances of messages and
+// the storage of the consumer's queue.
+memory_counter_t g_pending_memory;
+
+//
+// payload
+//
+// A message with some data to make the memory usage noticeable.
+//
+struct payload final : public so_5::message_t
+   {
+      std::array< char, 256 > m_data{};
+
+      static void *
+      operator new( std::size_t size )
+         {
+            void * p = ::operator new( size );
+            g_pending_memory.allocated( size );
+            return p;
+         }
+
+      static void
+      operator delete( void * p, std::size_t size ) noexcept
+         {
+            g_pending_memory.deallocated( size );
+            ::operator delete( p );
+         }
+   };
+
+//
+// counting_resource_t
+//
+// Upstream for the storage of the consumer's queue.
+//
+class counting_resource_t final : public std::pmr::memory_resource
+   {
+      std::pmr::memory_resource & m_upstream{
+            *std::pmr::new_delete_resource() };
+
+      void *
+      do_allocate( std::size_t bytes, std::size_t alignment ) override
+         {
+            void * p = m_upstream.allocate( bytes, alignment );
+            g_pending_memory.allocated( bytes );
+            return p;
+         }
+
+      void
+      do_deallocate(
+         void * p,
+         std::size_t bytes,
+         std::size_t alignment ) override
+         {
+            g_pending_memory.deallocated( bytes );
+            m_upstream.deallocate( p, bytes, alignment );
+         }
+
+      [[nodiscard]]
+      bool
+      do_is_equal(
+         const std::pmr::memory_resource & other ) const noexcept override
+         {
+            return this == &other;
+         }
+   };
+
+//
+// peak_tracking_fifo_t
+//
+// FIFO queue that remembers the max count of pending demands.
+// The storage of the queue is taken from counting_resource_t.
+//
+class peak_tracking_fifo_t final : public custom_queue_disps::demand_queue_t
+   {
+      // NOTE: it has to be declared before m_queue.
+      counting_resource_t m_memory;
+
+      demo::simple_fifo_t m_queue{
+            demo::default_expected_burst, &m_memory };
+
+      // It's updated under the dispatcher's lock but read from
+      // the main thread.
+      std::atomic< std::size_t > m_peak{};
+
+   public:
+      [[nodiscard]]
+      std::size_t
+      peak() const noexcept { return m_peak.load( std::memory_order_relaxed ); }
+
+      [[nodiscard]]
+      bool
+      empty() const noexcept override { return m_queue.empty(); }
+
+      [[nodiscard]]
+      std::size_t
+      size() const noexcept override { return m_queue.size(); }
+
+      [[nodiscard]]
+      std::optional<so_5::execution_demand_t>
+      try_extract() noexcept override { return m_queue.try_extract(); }
+
+      void
+      push( so_5::execution_demand_t demand ) override
+         {
+            m_queue.push( std::move(demand) );
+
+            const auto current = m_queue.size();
+            if( current > m_peak.load( std::memory_order_relaxed ) )
+               m_peak.store( current, std::memory_order_relaxed );
+         }
+   };
+
+//
+// consumer_t
+//
+// Spends the specified time for every message.
+//
+class consumer_t final : public so_5::agent_t
+   {
+   public:
+      consumer_t(
+         context_t ctx,
+         std::size_t expected,
+         clock_type::duration handling_time,
+         std::promise< void > & done )
+         :  so_5::agent_t{ std::move(ctx) }
+         ,  m_expected{ expected }
+         ,  m_handling_time{ handling_time }
+         ,  m_done{ done }
+         {}
+
+      void
+      so_define_agent() override
+         {
+            so_subscribe_self().event( &consumer_t::on_payload );
+         }
+
+   private:
+      const std::size_t m_expected;
+      const clock_type::duration m_handling_time;
+      std::promise< void > & m_done;
+
+      std::size_t m_received{};
+
+      void
+      on_payload( mhood_t<payload> )
+         {
+            // Busy waiting is used because sleep is too coarse.
+            const auto until = clock_type::now() + m_handling_time;
+            while( clock_type::now() < until ) {}
+
+            if( ++m_received == m_expected )
+               m_done.set_value();
+         }
+   };
+
+struct result_t
+   {
+      std::size_t m_peak;
+      std::size_t m_peak_memory;
+      clock_type::duration m_elapsed;
+   };
+
+[[nodiscard]]
+result_t
+run(
+   const custom_queue_disps::one_thread::binder_params_t & params,
+   std::size_t messages,
+   clock_type::duration handling_time )
+   {
+      so_5::wrapped_env_t sobj;
+
+      g_pending_memory.reset_peak();
+
+      auto queue = std::make_shared< peak_tracking_fifo_t >();
+      std::promise< void > done;
+      so_5::mbox_t consumer_mbox;
+
+      sobj.environment().introduce_coop( [&](so_5::coop_t & coop) {
+            auto disp = custom_queue_disps::one_thread::make_dispatcher(
+                  coop.environment() );
+            consumer_mbox = coop.make_agent_with_binder< consumer_t >(
+                  disp.binder( queue, params ),
+                  messages,
+                  handling_time,
+                  done )->so_direct_mbox();
+         } );
+
+      const auto started_at = clock_type::now();
+      for( std::size_t i = 0; i != messages; ++i )
+         so_5::send< payload >( consumer_mbox );
+
+      done.get_future().wait();
+      const auto elapsed = clock_type::now() - started_at;
+
+      sobj.stop_then_join();
+
+      return { queue->peak(), g_pending_memory.peak(), elapsed };
+   }
+
+void
+report( std::string_view mode, const result_t & r )
+   {
+      std::cout << std::left << std::setw( 24 ) << mode << std::right
+            << " peak queue: " << std::setw( 10 ) << r.m_peak
+            << " peak memory: " << std::setw( 10 ) << r.m_peak_memory / 1024u
+            << " KiB"
+            << " elapsed: "
+            << std::chrono::duration_cast< std::chrono::milliseconds >(
+                  r.m_elapsed ).count() << " ms"
+            << std::endl;
+   }
+
+} /* namespace bench */
+
+int
+main( int argc, char ** argv )
+   {
+      using namespace bench;
+      namespace cqd = custom_queue_disps::one_thread;
+
+      try
+         {
+            const std::size_t messages = argc > 1 ?
+                  std::strtoull( argv[ 1 ], nullptr, 10 ) : 200'000u;
+            const std::chrono::microseconds handling_time{
+                  argc > 2 ? std::strtoull( argv[ 2 ], nullptr, 10 ) : 5u };
+
+            std::cout << "messages: " << messages
+                  << ", handling time: " << handling_time.count() << "us"
+                  << std::endl;
+
+            report( "no backpressure",
+                  run( cqd::binder_params_t{}, messages, handling_time ) );
+            report( "backpressure 1000/500",
+                  run( cqd::binder_params_t{}.backpressure( 1000u, 500u ),
+                        messages, handling_time ) );
+            report( "backpressure 100/50",
+                  run( cqd::binder_params_t{}.backpressure( 100u, 50u ),
+                        messages, handling_time ) );
+         }
+      catch( const std::exception & x )
+         {
+            std::cerr << "Exception caught: " << x.what() << std::endl;
+            return 2;
+         }
+
+      return 0;
+   }
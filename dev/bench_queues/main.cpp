@@ -0,0 +1,805 @@
+/*
+ * A benchmark and stress test for demand_queue_t implementations.
+ *
+ * There are four modes:
+ *
+ * - micro. Queues are driven directly by synthetic demands without
+ *   SObjectizer's environment and dispatcher. The cost of push() and
+ *   try_extract() is measured for several depths of a queue and several
+ *   mixes of message types. The cost of a burst of demands that comes
+ *   to a new queue is measured too;
+ * - stress. Several producer threads send messages to agents bound
+ *   to one_thread dispatcher with the specified queue. Agents forward
+ *   some messages to each other and the queue is replaced several times
+ *   during the test. Half of producers use dispatcher_handle_t::push_batch().
+ *   It's checked that every message is received exactly once;
+ * - batching. Synthetic demands for many receivers are handled by
+ *   fine-grained handlers that touch the receiver's state. Throughput
+ *   of simple_fifo_t is compared with receiver_batching_t;
+ * - fanout. A producer delivers signals to many agents on one_thread
+ *   dispatcher via dispatcher_handle_t::push_batch() with different sizes
+ *   of batches. The time spent by the producer is measured.
+ *
+ * Usage:
+ *
+ *    bench_queues [micro|stress|batching|fanout] [<policy>...]
+ *
+ * All modes are run if mode isn't specified. If no policy is specified
+ * then all known policies are used (policies are ignored by batching
+ * and fanout modes).
+ */
+
+#include <demo/demand_queues.hpp>
+
+#include <custom_queue_disps/one_thread.hpp>
+
+#include <so_5/all.hpp>
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace bench_queues
+{
+
+using clock_type = std::chrono::steady_clock;
+
+using queue_factory_t =
+      std::function< custom_queue_disps::demand_queue_shptr_t() >;
+
+//
+// Message types for synthetic demands.
+//
+
+template< std::size_t N >
+struct synthetic_type_t final : public so_5::signal_t {};
+
+//
+// mix_t
+//
+// A set of message types for synthetic demands.
+//
+struct mix_t
+   {
+      std::string_view m_name;
+      std::vector< std::type_index > m_types;
+   };
+
+[[nodiscard]]
+std::vector< mix_t >
+make_mixes()
+   {
+      return {
+            { "1 type", { typeid(synthetic_type_t<0>) } },
+            { "8 types", {
+                  typeid(synthetic_type_t<0>), typeid(synthetic_type_t<1>),
+                  typeid(synthetic_type_t<2>), typeid(synthetic_type_t<3>),
+                  typeid(synthetic_type_t<4>), typeid(synthetic_type_t<5>),
+                  typeid(synthetic_type_t<6>), typeid(synthetic_type_t<7>) } },
+            // Types those have special priorities in demo queues.
+            { "demo signals", {
+                  typeid(demo::hello), typeid(demo::bye),
+                  typeid(demo::complete), typeid(synthetic_type_t<0>) } }
+         };
+   }
+
+//
+// micro benchmark
+//
+
+constexpr std::size_t receivers_count{ 16u };
+constexpr std::size_t pool_size{ 4096u };
+constexpr std::size_t batch_size{ 256u };
+constexpr std::size_t ops_per_measurement{ 1u << 20 };
+constexpr std::size_t burst_size{ 1024u };
+
+void
+noop_handler( so_5::current_thread_id_t, so_5::execution_demand_t & ) {}
+
+/*!
+ * Creates demands with random receivers and message types from @a mix.
+ */
+[[nodiscard]]
+std::vector< so_5::execution_demand_t >
+make_demand_pool( const mix_t & mix )
+   {
+      std::vector< so_5::execution_demand_t > pool;
+      pool.reserve( pool_size );
+
+      // Simple LCG is enough here and gives the same sequence every time.
+      std::uint32_t seed{ 12345u };
+      const auto next_random = [&seed] {
+            seed = seed * 1103515245u + 12345u;
+            return seed >> 16;
+         };
+
+      for( std::size_t i = 0u; i != pool_size; ++i )
+         pool.emplace_back(
+               // Receiver is used only as a key by queue policies.
+               // It's never dereferenced.
+               reinterpret_cast< so_5::agent_t * >(
+                     static_cast< std::uintptr_t >(
+                           next_random() % receivers_count + 1u ) ),
+               nullptr,
+               0u,
+               mix.m_types[ next_random() % mix.m_types.size() ],
+               so_5::message_ref_t{},
+               &noop_handler );
+
+      return pool;
+   }
+
+struct micro_result_t
+   {
+      double m_push_ns;
+      double m_extract_ns;
+   };
+
+/*!
+ * Measures push() and try_extract() when the queue holds
+ * from @a depth to @a depth + batch_size demands.
+ *
+ * @note
+ * The cost of push() includes the copy of execution_demand_t.
+ */
+[[nodiscard]]
+micro_result_t
+measure(
+   const queue_factory_t & factory,
+   std::size_t depth,
+   const std::vector< so_5::execution_demand_t > & pool )
+   {
+      auto queue = factory();
+
+      std::size_t next{};
+      const auto take = [&]() -> const so_5::execution_demand_t & {
+            return pool[ next++ % pool.size() ];
+         };
+
+      for( std::size_t i = 0u; i != depth; ++i )
+         queue->push( take() );
+
+      // Extracted demands are consumed somehow to prevent the compiler
+      // from optimizing extraction out.
+      std::uintptr_t sink{};
+
+      clock_type::duration push_time{};
+      clock_type::duration extract_time{};
+      for( std::size_t round = 0u;
+            round != ops_per_measurement / batch_size; ++round )
+         {
+            const auto started_at = clock_type::now();
+            for( std::size_t i = 0u; i != batch_size; ++i )
+               queue->push( take() );
+
+            const auto pushed_at = clock_type::now();
+            for( std::size_t i = 0u; i != batch_size; ++i )
+               if( auto d = queue->try_extract(); d )
+                  sink ^= reinterpret_cast< std::uintptr_t >( d->m_receiver );
+
+            extract_time += clock_type::now() - pushed_at;
+            push_time += pushed_at - started_at;
+         }
+
+      volatile std::uintptr_t keep = sink;
+      (void)keep;
+
+      const auto ns_per_op = []( clock_type::duration d ) {
+            return static_cast< double >(
+                  std::chrono::duration_cast< std::chrono::nanoseconds >(
+                        d ).count() ) / ops_per_measurement;
+         };
+
+      return { ns_per_op( push_time ), ns_per_op( extract_time ) };
+   }
+
+/*!
+ * Measures push() and try_extract() when a burst of burst_size demands
+ * comes to a new queue and then the queue is drained.
+ *
+ * @note
+ * The creation of a queue isn't included into the result.
+ */
+[[nodiscard]]
+micro_result_t
+measure_burst(
+   const queue_factory_t & factory,
+   const std::vector< so_5::execution_demand_t > & pool )
+   {
+      std::size_t next{};
+      std::uintptr_t sink{};
+
+      clock_type::duration push_time{};
+      clock_type::duration extract_time{};
+      for( std::size_t round = 0u;
+            round != ops_per_measurement / burst_size; ++round )
+         {
+            auto queue = factory();
+
+            const auto started_at = clock_type::now();
+            for( std::size_t i = 0u; i != burst_size; ++i )
+               queue->push( pool[ next++ % pool.size() ] );
+
+            const auto pushed_at = clock_type::now();
+            for( std::size_t i = 0u; i != burst_size; ++i )
+               if( auto d = queue->try_extract(); d )
+                  sink ^= reinterpret_cast< std::uintptr_t >( d->m_receiver );
+
+            extract_time += clock_type::now() - pushed_at;
+            push_time += pushed_at - started_at;
+         }
+
+      volatile std::uintptr_t keep = sink;
+      (void)keep;
+
+      const auto ns_per_op = []( clock_type::duration d ) {
+            return static_cast< double >(
+                  std::chrono::duration_cast< std::chrono::nanoseconds >(
+                        d ).count() ) / ops_per_measurement;
+         };
+
+      return { ns_per_op( push_time ), ns_per_op( extract_time ) };
+   }
+
+void
+run_micro( const std::string & policy_name, const queue_factory_t & factory )
+   {
+      std::cout << "=== micro: " << policy_name << " ===" << std::endl;
+      for( const auto & mix : make_mixes() )
+         {
+            const auto pool = make_demand_pool( mix );
+            for( const std::size_t depth : { 0u, 1024u, 65536u } )
+               {
+                  const auto r = measure( factory, depth, pool );
+                  std::cout << "  " << std::left << std::setw( 14 ) << mix.m_name
+                        << std::right
+                        << " depth=" << std::setw( 6 ) << depth
+                        << std::fixed << std::setprecision( 1 )
+                        << " push=" << std::setw( 7 ) << r.m_push_ns << "ns/op"
+                        << " extract=" << std::setw( 7 ) << r.m_extract_ns
+                        << "ns/op" << std::endl;
+               }
+
+            const auto r = measure_burst( factory, pool );
+            std::cout << "  " << std::left << std::setw( 14 ) << mix.m_name
+                  << std::right
+                  << " burst=" << std::setw( 6 ) << burst_size
+                  << std::fixed << std::setprecision( 1 )
+                  << " push=" << std::setw( 7 ) << r.m_push_ns << "ns/op"
+                  << " extract=" << std::setw( 7 ) << r.m_extract_ns
+                  << "ns/op" << std::endl;
+         }
+   }
+
+//
+// stress test
+//
+
+constexpr std::size_t stress_producers{ 4u };
+constexpr std::size_t stress_messages_per_producer{ 100'000u };
+constexpr std::size_t stress_agents{ 8u };
+constexpr std::size_t stress_batch_size{ 32u };
+
+struct stress_msg final : public so_5::message_t
+   {
+      const std::size_t m_producer;
+      const std::size_t m_seq;
+      const unsigned m_hops;
+
+      stress_msg( std::size_t producer, std::size_t seq, unsigned hops )
+         :  m_producer{ producer }
+         ,  m_seq{ seq }
+         ,  m_hops{ hops }
+         {}
+   };
+
+//
+// stress_state_t
+//
+// Counters of received messages.
+//
+// All stress agents work on the same worker thread, so there is no need
+// in synchronization. The main thread reads counters after the completion
+// of the test.
+//
+struct stress_state_t
+   {
+      std::vector< std::vector< std::uint8_t > > m_counters;
+      std::size_t m_received{};
+      std::promise< void > m_done;
+
+      stress_state_t()
+         :  m_counters( stress_producers,
+               std::vector< std::uint8_t >( stress_messages_per_producer ) )
+         {}
+
+      void
+      received( std::size_t producer, std::size_t seq )
+         {
+            auto & c = m_counters[ producer ][ seq ];
+            if( c < 255u )
+               ++c;
+
+            if( ++m_received == stress_producers * stress_messages_per_producer )
+               m_done.set_value();
+         }
+   };
+
+//
+// stress_agent_t
+//
+// Every 4th message from producers is forwarded to the next agent.
+// It checks the delivery from the worker thread.
+//
+class stress_agent_t final : public so_5::agent_t
+   {
+   public:
+      stress_agent_t( context_t ctx, stress_state_t & state )
+         :  so_5::agent_t{ std::move(ctx) }
+         ,  m_state{ state }
+         {}
+
+      void
+      set_next( so_5::mbox_t next ) { m_next = std::move(next); }
+
+      void
+      so_define_agent() override
+         {
+            so_subscribe_self().event( &stress_agent_t::on_msg );
+         }
+
+   private:
+      stress_state_t & m_state;
+      so_5::mbox_t m_next;
+
+      void
+      on_msg( mhood_t<stress_msg> cmd )
+         {
+            if( 0u == cmd->m_hops && 0u == cmd->m_seq % 4u )
+               so_5::send< stress_msg >( m_next,
+                     cmd->m_producer, cmd->m_seq, 1u );
+            else
+               m_state.received( cmd->m_producer, cmd->m_seq );
+         }
+   };
+
+[[nodiscard]]
+so_5::execution_demand_t
+make_stress_demand(
+   so_5::agent_t & receiver,
+   std::size_t producer,
+   std::size_t seq )
+   {
+      return {
+            &receiver,
+            nullptr,
+            receiver.so_direct_mbox()->id(),
+            typeid(stress_msg),
+            so_5::message_ref_t{
+                  std::make_unique< stress_msg >( producer, seq, 0u )
+            },
+            so_5::agent_t::get_demand_handler_on_message_ptr()
+         };
+   }
+
+[[nodiscard]]
+bool
+run_stress( const std::string & policy_name, const queue_factory_t & factory )
+   {
+      std::cout << "=== stress: " << policy_name << " ===" << std::endl;
+
+      stress_state_t state;
+      std::vector< stress_agent_t * > agents;
+      std::vector< so_5::mbox_t > mboxes;
+
+      so_5::wrapped_env_t sobj;
+
+      auto disp = custom_queue_disps::one_thread::make_dispatcher(
+            sobj.environment() );
+      auto binder = disp.binder( factory() );
+
+      sobj.environment().introduce_coop( [&](so_5::coop_t & coop) {
+            for( std::size_t i = 0u; i != stress_agents; ++i )
+               {
+                  agents.push_back(
+                        coop.make_agent_with_binder< stress_agent_t >(
+                              binder, state ) );
+                  mboxes.push_back( agents.back()->so_direct_mbox() );
+               }
+
+            for( std::size_t i = 0u; i != stress_agents; ++i )
+               agents[ i ]->set_next( mboxes[ (i + 1u) % stress_agents ] );
+         } );
+
+      const auto started_at = clock_type::now();
+
+      std::vector< std::thread > producers;
+      for( std::size_t p = 0u; p != stress_producers; ++p )
+         if( 0u == p % 2u )
+            producers.emplace_back( [p, &mboxes] {
+                  for( std::size_t i = 0u; i != stress_messages_per_producer; ++i )
+                     so_5::send< stress_msg >(
+                           mboxes[ (p + i) % mboxes.size() ], p, i, 0u );
+               } );
+         else
+            producers.emplace_back( [p, &agents, &disp, &binder] {
+                  std::vector< so_5::execution_demand_t > batch;
+                  for( std::size_t i = 0u; i != stress_messages_per_producer; ++i )
+                     {
+                        batch.push_back( make_stress_demand(
+                              *agents[ (p + i) % agents.size() ], p, i ) );
+                        if( stress_batch_size == batch.size() ||
+                              stress_messages_per_producer == i + 1u )
+                           {
+                              disp.push_batch( binder,
+                                    batch.data(), batch.data() + batch.size() );
+                              batch.clear();
+                           }
+                     }
+               } );
+
+      // Demand queue is replaced during the test to check the migration
+      // of pending demands.
+      auto done = state.m_done.get_future();
+      const auto deadline = started_at + std::chrono::seconds{ 60 };
+      std::size_t swaps{};
+      while( std::future_status::ready !=
+               done.wait_for( std::chrono::milliseconds{ 1 } ) &&
+            clock_type::now() < deadline )
+         {
+            disp.change_demand_queue( binder, factory() );
+            ++swaps;
+         }
+
+      const auto elapsed = clock_type::now() - started_at;
+
+      for( auto & t : producers )
+         t.join();
+
+      const bool completed = std::future_status::ready == done.wait_for(
+            std::chrono::seconds{ 5 } );
+
+      sobj.stop_then_join();
+
+      std::size_t lost{};
+      std::size_t duplicated{};
+      for( const auto & counters : state.m_counters )
+         for( const auto c : counters )
+            {
+               if( 0u == c )
+                  ++lost;
+               else if( 1u < c )
+                  ++duplicated;
+            }
+
+      const bool ok = completed && 0u == lost && 0u == duplicated;
+      std::cout << "  messages=" << stress_producers * stress_messages_per_producer
+            << " received=" << state.m_received
+            << " lost=" << lost
+            << " duplicated=" << duplicated
+            << " queue swaps=" << swaps
+            << " elapsed="
+            << std::chrono::duration_cast< std::chrono::milliseconds >(
+                  elapsed ).count() << "ms"
+            << ( ok ? " OK" : " FAILED" ) << std::endl;
+
+      return ok;
+   }
+
+//
+// batching benchmark
+//
+
+constexpr std::size_t batching_receivers{ 512u };
+constexpr std::size_t batching_demands_per_receiver{ 64u };
+constexpr std::size_t batching_rounds{ 20u };
+
+//
+// receiver_state_t
+//
+// State of a receiver. It's big enough to not fit into L2 cache
+// for all receivers.
+//
+struct alignas( 64 ) receiver_state_t
+   {
+      std::array< std::uint64_t, 512 > m_data{};
+   };
+
+std::vector< receiver_state_t > g_receiver_states;
+
+// Touches a part of the receiver's state.
+void
+fine_grained_handler(
+   so_5::current_thread_id_t,
+   so_5::execution_demand_t & d )
+   {
+      auto & state = g_receiver_states[
+            reinterpret_cast< std::uintptr_t >( d.m_receiver ) - 1u ];
+      for( std::size_t i = 0u; i < state.m_data.size(); i += 8u )
+         state.m_data[ i ] += i;
+   }
+
+/*!
+ * Returns the count of handled demands per second.
+ *
+ * Demands for all receivers are pushed in interleaved order (A, B, C,
+ * A, B, C, ...) and then all of them are handled.
+ */
+[[nodiscard]]
+double
+measure_batching( const queue_factory_t & factory )
+   {
+      const auto thread_id = so_5::query_current_thread_id();
+      auto queue = factory();
+
+      clock_type::duration total{};
+      for( std::size_t round = 0u; round != batching_rounds; ++round )
+         {
+            for( std::size_t i = 0u; i != batching_demands_per_receiver; ++i )
+               for( std::size_t r = 0u; r != batching_receivers; ++r )
+                  queue->push( so_5::execution_demand_t{
+                        // Receiver is used as the index of its state.
+                        // It's never dereferenced.
+                        reinterpret_cast< so_5::agent_t * >(
+                              static_cast< std::uintptr_t >( r + 1u ) ),
+                        nullptr,
+                        0u,
+                        typeid(synthetic_type_t<0>),
+                        so_5::message_ref_t{},
+                        &fine_grained_handler } );
+
+            const auto started_at = clock_type::now();
+            while( !queue->empty() )
+               if( auto d = queue->try_extract(); d )
+                  d->call_handler( thread_id );
+            total += clock_type::now() - started_at;
+         }
+
+      const std::chrono::duration< double > seconds = total;
+      return static_cast< double >( batching_rounds * batching_receivers *
+            batching_demands_per_receiver ) / seconds.count();
+   }
+
+void
+run_batching()
+   {
+      std::cout << "=== batching: " << batching_receivers << " receivers, "
+            << sizeof(receiver_state_t) << " bytes of state each ==="
+            << std::endl;
+
+      g_receiver_states.resize( batching_receivers );
+
+      const std::pair< std::string_view, queue_factory_t > policies[] = {
+            { "simple_fifo",
+               []{ return std::make_shared< demo::simple_fifo_t >(); } },
+            { "receiver_batching(4)",
+               []{ return std::make_shared< demo::receiver_batching_t >( 4u ); } },
+            { "receiver_batching(16)",
+               []{ return std::make_shared< demo::receiver_batching_t >( 16u ); } },
+            { "receiver_batching(64)",
+               []{ return std::make_shared< demo::receiver_batching_t >( 64u ); } }
+         };
+
+      for( const auto & [name, factory] : policies )
+         std::cout << "  " << std::left << std::setw( 24 ) << name
+               << std::right << std::fixed << std::setprecision( 2 )
+               << " " << measure_batching( factory ) / 1e6
+               << "M demands/s" << std::endl;
+   }
+
+//
+// fanout benchmark
+//
+
+constexpr std::size_t fanout_agents{ 64u };
+constexpr std::size_t fanout_messages{ 1'000'000u };
+
+struct fanout_signal final : public so_5::signal_t {};
+
+//
+// fanout_agent_t
+//
+// All fanout agents work on the same worker thread, so the counter
+// isn't protected.
+//
+class fanout_agent_t final : public so_5::agent_t
+   {
+   public:
+      fanout_agent_t(
+         context_t ctx,
+         std::size_t & received,
+         std::promise< void > & done )
+         :  so_5::agent_t{ std::move(ctx) }
+         ,  m_received{ received }
+         ,  m_done{ done }
+         {}
+
+      void
+      so_define_agent() override
+         {
+            so_subscribe_self().event( &fanout_agent_t::on_signal );
+         }
+
+   private:
+      std::size_t & m_received;
+      std::promise< void > & m_done;
+
+      void
+      on_signal( mhood_t<fanout_signal> )
+         {
+            if( ++m_received == fanout_messages )
+               m_done.set_value();
+         }
+   };
+
+struct fanout_result_t
+   {
+      clock_type::duration m_producer_time;
+      clock_type::duration m_total_time;
+   };
+
+[[nodiscard]]
+fanout_result_t
+measure_fanout( std::size_t batch_size )
+   {
+      std::size_t received{};
+      std::promise< void > done;
+      std::vector< fanout_agent_t * > agents;
+
+      so_5::wrapped_env_t sobj;
+
+      auto disp = custom_queue_disps::one_thread::make_dispatcher(
+            sobj.environment() );
+      auto binder = disp.binder( std::make_shared< demo::simple_fifo_t >() );
+
+      sobj.environment().introduce_coop( [&](so_5::coop_t & coop) {
+            for( std::size_t i = 0u; i != fanout_agents; ++i )
+               agents.push_back( coop.make_agent_with_binder< fanout_agent_t >(
+                     binder, received, done ) );
+         } );
+
+      std::vector< so_5::mbox_id_t > mbox_ids;
+      for( auto * a : agents )
+         mbox_ids.push_back( a->so_direct_mbox()->id() );
+
+      const auto started_at = clock_type::now();
+
+      std::vector< so_5::execution_demand_t > batch;
+      batch.reserve( batch_size );
+      for( std::size_t i = 0u; i != fanout_messages; ++i )
+         {
+            const auto index = i % fanout_agents;
+            batch.emplace_back(
+                  agents[ index ],
+                  nullptr,
+                  mbox_ids[ index ],
+                  typeid(fanout_signal),
+                  so_5::message_ref_t{},
+                  so_5::agent_t::get_demand_handler_on_message_ptr() );
+            if( batch_size == batch.size() || fanout_messages == i + 1u )
+               {
+                  disp.push_batch( binder,
+                        batch.data(), batch.data() + batch.size() );
+                  batch.clear();
+               }
+         }
+
+      const auto pushed_at = clock_type::now();
+      done.get_future().wait();
+      const auto finished_at = clock_type::now();
+
+      sobj.stop_then_join();
+
+      return { pushed_at - started_at, finished_at - started_at };
+   }
+
+void
+run_fanout()
+   {
+      std::cout << "=== fanout: " << fanout_messages << " signals to "
+            << fanout_agents << " agents ===" << std::endl;
+
+      for( const std::size_t batch_size : { 1u, 16u, 256u } )
+         {
+            const auto r = measure_fanout( batch_size );
+            const auto ns_per_msg = []( clock_type::duration d ) {
+                  return static_cast< double >(
+                        std::chrono::duration_cast< std::chrono::nanoseconds >(
+                              d ).count() ) / fanout_messages;
+               };
+
+            std::cout << "  batch=" << std::setw( 4 ) << batch_size
+                  << std::fixed << std::setprecision( 1 )
+                  << " producer=" << std::setw( 7 )
+                  << ns_per_msg( r.m_producer_time ) << "ns/msg"
+                  << " total=" << std::setw( 7 )
+                  << ns_per_msg( r.m_total_time ) << "ns/msg" << std::endl;
+         }
+   }
+
+} /* namespace bench_queues */
+
+int main( int argc, char ** argv )
+   {
+      using namespace bench_queues;
+
+      const std::map< std::string, queue_factory_t > policies{
+            { "simple_fifo",
+               []{ return std::make_shared< demo::simple_fifo_t >(); } },
+            { "hardcoded_priorities",
+               []{ return std::make_shared< demo::hardcoded_priorities_t >(); } },
+            { "dynamic_per_agent_priorities",
+               []{ return std::make_shared< demo::dynamic_per_agent_priorities_t >(); } },
+            { "rate_limited",
+               []{ return std::make_shared< demo::rate_limited_t >(); } },
+            { "receiver_batching",
+               []{ return std::make_shared< demo::receiver_batching_t >(); } }
+         };
+
+      try
+         {
+            int first_policy = 1;
+            bool micro = true;
+            bool stress = true;
+            bool batching = true;
+            bool fanout = true;
+            if( argc > 1 )
+               {
+                  const std::string_view mode{ argv[ 1 ] };
+                  if( "micro" == mode || "stress" == mode ||
+                        "batching" == mode || "fanout" == mode )
+                     {
+                        micro = "micro" == mode;
+                        stress = "stress" == mode;
+                        batching = "batching" == mode;
+                        fanout = "fanout" == mode;
+                        ++first_policy;
+                     }
+               }
+
+            std::vector< std::map< std::string, queue_factory_t >::const_iterator >
+                  selected;
+            if( first_policy == argc )
+               for( auto it = policies.begin(); it != policies.end(); ++it )
+                  selected.push_back( it );
+            else
+               for( int i = first_policy; i < argc; ++i )
+                  {
+                     const auto it = policies.find( argv[ i ] );
+                     if( it == policies.end() )
+                        throw std::runtime_error(
+                              std::string{ "unknown policy: " } + argv[ i ] );
+                     selected.push_back( it );
+                  }
+
+            bool ok = true;
+            for( const auto & it : selected )
+               {
+                  if( micro )
+                     run_micro( it->first, it->second );
+                  if( stress )
+                     ok = run_stress( it->first, it->second ) && ok;
+               }
+
+            if( batching )
+               run_batching();
+            if( fanout )
+               run_fanout();
+
+            return ok ? 0 : 1;
+         }
+      catch( const std::exception & x )
+         {
+            std::cerr << "*** Exception caught: " << x.what() << std::endl;
+            return 2;
+         }
+   }
@@ -21,4 +21,8 @@ MxxRu::Cpp::composite_target( MxxRu::BUILD_ROOT ) {
 
   required_prj 'custom_queue_disps/prj.rb'
   required_prj 'demo/prj.rb'
+  required_prj 'trace_replay/prj.rb'
+  required_prj 'bench_backpressure/prj.rb'
+  required_prj 'bench_queues/prj.rb'
+  required_prj 'test/thread_priority/prj.rb'
 }
@@ -2,6 +2,8 @@
 
 #include <so_5/all.hpp>
 
+#include <chrono>
+#include <cstddef>
 #include <optional>
 
 namespace custom_queue_disps
@@ -26,6 +28,9 @@ class demand_queue_t
       //! Will be
       demand_queue_t * m_next{ nullptr };
 
+      //! Is the queue in dispatcher's list of deferred queues?
+      bool m_deferred{ false };
+
    public:
       demand_queue_t() = default;
       virtual ~demand_queue_t() = default;
@@ -40,6 +45,13 @@ class demand_queue_t
       void
       drop_next() noexcept { set_next( nullptr ); }
 
+      [[nodiscard]]
+      bool
+      is_deferred() const noexcept { return m_deferred; }
+
+      void
+      set_deferred( bool v ) noexcept { m_deferred = v; }
+
       /*!
        * Should return false if the queue is empty.
        */
@@ -75,12 +87,90 @@ class demand_queue_t
       virtual std::optional<so_5::execution_demand_t>
       try_extract() noexcept = 0;
 
+      /*!
+       * Should extract the next demand regardless of its readiness.
+       *
+       * It is used when the queue is replaced by another one (see
+       * one_thread::dispatcher_handle_t::change_demand_queue()). All
+       * demands have to be moved to the new queue, including demands
+       * that try_extract() doesn't give away at the moment (for example,
+       * because of rate limits). It is called only for a non-empty queue.
+       * If it returns an empty std::optional the replacement of the queue
+       * is cancelled.
+       *
+       * The default implementation calls try_extract(). A queue whose
+       * try_extract() can return an empty std::optional while the queue
+       * isn't empty should override it.
+       */
+      [[nodiscard]]
+      virtual std::optional<so_5::execution_demand_t>
+      extract_for_migration() noexcept { return try_extract(); }
+
       /*!
        * Should store a @a demand in the queue or throw an exception
        * if this is impossible.
+       *
+       * @note
+       * Usually an exception goes to the sender of the demand. But
+       * demands sent from the dispatcher's worker thread (for example,
+       * by an agent to itself) are stored in the queue later, when
+       * the sender has already finished its work. An exception for
+       * such demand is reported to SObjectizer's error_logger and
+       * the demand is lost.
        */
       virtual void
       push( so_5::execution_demand_t demand ) = 0;
+
+      /*!
+       * Should store all demands from [@a first, @a last) in the queue.
+       * Demands can be moved from that range.
+       *
+       * The dispatcher calls it for a batch of demands pushed under
+       * one acquisition of the dispatcher's lock. The default
+       * implementation calls push() for every demand. A queue can
+       * override it to reserve space or to update its indexes once.
+       *
+       * @note
+       * If an exception is thrown, demands stored before that
+       * exception stay in the queue.
+       */
+      virtual void
+      push_batch(
+         so_5::execution_demand_t * first,
+         so_5::execution_demand_t * last )
+         {
+            for( ; first != last; ++first )
+               push( std::move(*first) );
+         }
+
+      /*!
+       * Should return the count of demands in the queue.
+       *
+       * It is used only for backpressure (see
+       * one_thread::binder_params_t::backpressure()). The default
+       * implementation returns 0, so a queue without its own
+       * implementation is never considered full.
+       */
+      [[nodiscard]]
+      virtual std::size_t
+      size() const noexcept { return 0u; }
+
+      /*!
+       * Should return a time point when the queue will have a demand
+       * ready to process.
+       *
+       * It is called by the dispatcher if try_extract() returned an empty
+       * std::optional but the queue isn't empty. If a time point in the
+       * future is returned then the dispatcher won't call try_extract()
+       * until that time point or until a new demand is pushed to the queue.
+       * So the dispatcher doesn't spin on the queue.
+       *
+       * The default implementation returns an empty std::optional. It means
+       * that try_extract() should be called again as soon as possible.
+       */
+      [[nodiscard]]
+      virtual std::optional< std::chrono::steady_clock::time_point >
+      ready_at() const noexcept { return std::nullopt; }
    };
 
 /*!
@@ -1,6 +1,24 @@
 #include <custom_queue_disps/one_thread.hpp>
+#include <custom_queue_disps/probes.hpp>
 
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <limits>
 #include <optional>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+#if defined(__linux__)
+   #include <pthread.h>
+   #include <sched.h>
+   #include <sys/eventfd.h>
+   #include <time.h>
+   #include <unistd.h>
+#endif
 
 namespace custom_queue_disps
 {
@@ -11,6 +29,53 @@ namespace one_thread
 namespace impl
 {
 
+class actual_event_queue_t;
+
+/*!
+ * Returns the description of the exception that is being handled.
+ *
+ * @attention
+ * Must be called from a catch block.
+ */
+[[nodiscard]]
+std::string
+current_exception_description()
+   {
+      try
+         {
+            throw;
+         }
+      catch( const std::exception & x )
+         {
+            return x.what();
+         }
+      catch( ... )
+         {
+            return "unknown exception";
+         }
+   }
+
+/*!
+ * Returns the CPU time consumed by the current thread.
+ *
+ * @note
+ * The time of a steady clock is returned if there is no
+ * thread CPU clock on the platform.
+ */
+[[nodiscard]]
+std::chrono::nanoseconds
+thread_cpu_time() noexcept
+   {
+#if defined(__linux__)
+      timespec ts;
+      if( 0 == ::clock_gettime( CLOCK_THREAD_CPUTIME_ID, &ts ) )
+         return std::chrono::seconds{ ts.tv_sec } +
+               std::chrono::nanoseconds{ ts.tv_nsec };
+#endif
+      return std::chrono::duration_cast< std::chrono::nanoseconds >(
+            std::chrono::steady_clock::now().time_since_epoch() );
+   }
+
 //
 // dispatcher_data_t
 //
@@ -22,24 +87,556 @@ namespace impl
  */
 struct dispatcher_data_t
    {
+      /*!
+       * A demand that was pushed from the worker thread.
+       *
+       * Such demands are collected without locking the dispatcher
+       * and moved to their demand_queues before the next extraction.
+       */
+      struct staged_demand_t;
+
+      /*!
+       * A flag that tells whether an event_queue still exists.
+       *
+       * It's shared between an event_queue and requests for that
+       * event_queue that are handled by the worker thread later
+       * (staged demands and replacements of demand_queue). The binder
+       * can be destroyed before the worker thread gets to them.
+       *
+       * @attention
+       * m_alive is protected by m_lock.
+       */
+      struct event_queue_lifetime_t
+         {
+            bool m_alive{ true };
+         };
+
+      using event_queue_lifetime_shptr_t =
+            std::shared_ptr< event_queue_lifetime_t >;
+
+      /*!
+       * A scheduling group.
+       *
+       * Every group has its own list of non-empty subqueues. The worker
+       * thread selects a group by weighted fair queuing (a non-empty group
+       * with the smallest virtual time is selected) and then takes the
+       * first subqueue from the group's list.
+       */
+      struct group_t
+         {
+            const std::string m_name;
+            const unsigned m_weight;
+
+            /*!
+             * The head of queue of non-empty subqueues.
+             *
+             * nullptr means that there is no non-empty subqueues.
+             */
+            demand_queue_t * m_head{ nullptr };
+            /*!
+             * The tail of queue of non-empty subqueues.
+             *
+             * It is used for quick addition of new subqueue to the
+             * list of non-empty subqueues.
+             */
+            demand_queue_t * m_tail{ nullptr };
+
+            //! CPU time consumed by handlers divided by the weight.
+            double m_virtual_time{};
+
+            //! Total CPU time consumed by handlers of the group.
+            std::chrono::nanoseconds m_cpu_time{};
+
+            //! Total count of handled demands.
+            std::uint64_t m_demands_handled{};
+
+            group_t( std::string name, unsigned weight )
+               :  m_name{ std::move(name) }
+               ,  m_weight{ weight }
+               {}
+         };
+
+      /*!
+       * A non-empty subqueue that has no ready demands until
+       * the specified time point.
+       */
+      struct deferred_queue_t
+         {
+            std::chrono::steady_clock::time_point m_ready_at;
+            group_t * m_group;
+            demand_queue_t * m_queue;
+         };
+
+      /*!
+       * @note
+       * The demand_queue can't be replaced between the staging of
+       * a demand and the merge, so a raw pointer is enough. But it
+       * can be used only if m_lifetime->m_alive is set.
+       */
+      struct staged_demand_t
+         {
+            group_t * m_group;
+            demand_queue_t * m_queue;
+            event_queue_lifetime_shptr_t m_lifetime;
+            so_5::execution_demand_t m_demand;
+         };
+
+      /*!
+       * A request for replacement of binder's demand_queue.
+       *
+       * @note
+       * The request is ignored if the binder is destroyed before
+       * the replacement (m_lifetime->m_alive is cleared in that case).
+       */
+      struct queue_change_t
+         {
+            actual_event_queue_t * m_event_queue;
+            event_queue_lifetime_shptr_t m_lifetime;
+            demand_queue_shptr_t m_new_queue;
+         };
+
+      //! A producer that waits for free space in a demand_queue.
+      struct backpressure_waiter_t
+         {
+            demand_queue_t * m_queue;
+            std::size_t m_low_watermark;
+         };
+
+      //! SOEnv is used for logging of errors.
+      so_5::environment_t & m_env;
+
       std::mutex m_lock;
       std::condition_variable m_wakeup_cv;
 
+      //! Producers blocked by backpressure wait on that condition.
+      std::condition_variable m_space_cv;
+
       bool m_shutdown{ false };
 
       /*!
-       * The head of queue of non-empty subqueues.
+       * Scheduling groups.
+       *
+       * The first item is the default group.
+       *
+       * @note
+       * The content of that container isn't changed after the creation
+       * of the dispatcher. So pointers to groups are stable.
+       */
+      std::vector< group_t > m_groups;
+
+      //! Count of groups with non-empty subqueues.
+      std::size_t m_active_groups{};
+
+      //! Virtual time of the last selected group.
+      double m_virtual_time{};
+
+      /*!
+       * Non-empty subqueues without ready demands.
        *
-       * nullptr means that there is no non-empty subqueues.
+       * Such subqueues aren't in lists of non-empty subqueues.
+       * They are returned to those lists when a new demand is pushed
+       * or their time comes.
+       *
+       * @note
+       * It's expected that there are just a few such subqueues,
+       * so a simple vector is used.
        */
-      demand_queue_t * m_head{ nullptr };
+      std::vector< deferred_queue_t > m_deferred_queues;
+
+      /*!
+       * ID of the worker thread.
+       *
+       * In the dedicated thread mode it is set by the dispatcher
+       * before the creation of any binder and isn't changed after that.
+       *
+       * In the caller-driven mode it is the ID of the thread that is
+       * inside dispatcher_t::run_available() at the moment.
+       *
+       * @note
+       * A thread can only see its own ID there, so relaxed memory
+       * order is enough for reading that value.
+       */
+      std::atomic< so_5::current_thread_id_t > m_worker_thread_id{};
+
+#if defined(__linux__)
+      /*!
+       * Eventfd for the caller-driven mode.
+       *
+       * It is readable while there are non-empty subqueues or pending
+       * replacements of demand_queues.
+       *
+       * -1 in the dedicated thread mode.
+       */
+      int m_event_fd{ -1 };
+#endif
+
+      /*!
+       * Demands pushed from the worker thread.
+       *
+       * @attention
+       * It is accessed only from the worker thread, so it isn't
+       * protected by m_lock.
+       */
+      std::vector< staged_demand_t > m_staged_demands;
+
+      /*!
+       * Requests for replacement of demand_queues that have to be
+       * handled by the worker thread.
+       */
+      std::vector< queue_change_t > m_queue_changes;
+
+      /*!
+       * Producers blocked by backpressure.
+       *
+       * @note
+       * It's expected that there are just a few such producers,
+       * so a simple vector is used.
+       */
+      std::vector< backpressure_waiter_t > m_backpressure_waiters;
+
+      //! Optional recorder for demand's events.
+      /*!
+       * It is set before the start of the worker thread and isn't
+       * changed after that.
+       */
+      trace::recorder_shptr_t m_recorder;
+
+      explicit dispatcher_data_t( so_5::environment_t & env ) noexcept
+         :  m_env{ env }
+         {}
+
+      /*!
+       * Reports a problem that can't be reported to a sender
+       * of a demand.
+       *
+       * It's used in noexcept contexts, so errors are ignored.
+       */
+      template< typename Message_Maker >
+      void
+      log_error(
+         const char * file_name,
+         unsigned int line,
+         Message_Maker && message_maker ) noexcept
+         {
+            // There is nothing to do if logging fails.
+            try
+               {
+                  m_env.error_logger().log( file_name, line,
+                        "custom_queue_disps::one_thread: " + message_maker() );
+               }
+            catch( ... ) {}
+         }
+
+      /*!
+       * Stores @a demand into @a q and includes @a q into the list
+       * of non-empty subqueues if @a q was empty.
+       *
+       * Returns true if the list of non-empty subqueues was empty
+       * (it means that the worker thread has to be woken up).
+       *
+       * @attention
+       * Must be called with m_lock acquired.
+       */
+      [[nodiscard]]
+      bool
+      push_to_subqueue(
+         group_t & group,
+         demand_queue_t & q,
+         so_5::execution_demand_t demand )
+         {
+            const bool queue_was_empty = q.empty();
+            if( queue_was_empty )
+               CQD_DEMAND_PROBE( queue_activated, &q, demand );
+
+            q.push( std::move(demand) );
+
+            return activate_after_push( group, q, queue_was_empty );
+         }
+
+      /*!
+       * Stores demands from [@a first, @a last) into @a q and includes
+       * @a q into the list of non-empty subqueues if @a q was empty.
+       *
+       * Returns true if the worker thread has to be woken up.
+       *
+       * @note
+       * If @a q throws then demands stored before the exception will be
+       * handled, the worker thread is woken up if necessary.
+       *
+       * @attention
+       * Must be called with m_lock acquired.
+       */
+      [[nodiscard]]
+      bool
+      push_batch_to_subqueue(
+         group_t & group,
+         demand_queue_t & q,
+         so_5::execution_demand_t * first,
+         so_5::execution_demand_t * last )
+         {
+            const bool queue_was_empty = q.empty();
+            if( queue_was_empty && first != last )
+               CQD_DEMAND_PROBE( queue_activated, &q, *first );
+
+            try
+               {
+                  q.push_batch( first, last );
+               }
+            catch( ... )
+               {
+                  if( activate_after_push( group, q, queue_was_empty ) )
+                     wake_up();
+                  throw;
+               }
+
+            return activate_after_push( group, q, queue_was_empty );
+         }
+
+      /*!
+       * Includes @a q into the list of non-empty subqueues if it's
+       * necessary after the push of new demands.
+       *
+       * Returns true if the list of non-empty subqueues was empty.
+       *
+       * @attention
+       * Must be called with m_lock acquired.
+       */
+      [[nodiscard]]
+      bool
+      activate_after_push(
+         group_t & group,
+         demand_queue_t & q,
+         bool queue_was_empty ) noexcept
+         {
+            //NOTE: if the queue wasn't empty it is already in active queue.
+            //So there is no need to modity active queue.
+            //The exception is a deferred queue: the new demand can be
+            //ready right now, so the queue should be checked again.
+            if( q.empty() || (!queue_was_empty && !q.is_deferred()) )
+               return false;
+
+            if( q.is_deferred() )
+               remove_from_deferred_list( q );
+
+            const bool disp_was_sleeping = (0u == m_active_groups);
+            append_to_active_list( group, q );
+
+            return disp_was_sleeping;
+         }
+
+      //! Wakes the dispatcher up.
+      /*!
+       * @attention
+       * Must be called with m_lock acquired.
+       */
+      void
+      wake_up() noexcept
+         {
+#if defined(__linux__)
+            if( -1 != m_event_fd )
+               {
+                  const std::uint64_t increment{ 1u };
+                  // The only possible error is overflow of the counter,
+                  // but the eventfd is readable in that case anyway.
+                  (void)::write( m_event_fd, &increment, sizeof(increment) );
+                  return;
+               }
+#endif
+            m_wakeup_cv.notify_one();
+         }
+
+      //! Adds @a q to the end of the group's list of non-empty subqueues.
+      void
+      append_to_active_list( group_t & group, demand_queue_t & q ) noexcept
+         {
+            if( group.m_tail )
+               group.m_tail->set_next( &q );
+            else
+               {
+                  group.m_head = &q;
+                  ++m_active_groups;
+
+                  // An idle group shouldn't accumulate credit for
+                  // the time it was idle.
+                  group.m_virtual_time = std::max(
+                        group.m_virtual_time, m_virtual_time );
+               }
+
+            group.m_tail = &q;
+         }
+
+      //! Removes the first item from the group's list of non-empty
+      //! subqueues.
+      /*!
+       * @attention
+       * The list must not be empty.
+       */
+      [[nodiscard]]
+      demand_queue_t &
+      pop_from_active_list( group_t & group ) noexcept
+         {
+            auto * q = group.m_head;
+            group.m_head = q->next();
+            q->drop_next();
+
+            if( !group.m_head )
+               {
+                  group.m_tail = nullptr;
+                  --m_active_groups;
+               }
+
+            return *q;
+         }
+
+      //! Removes @a q from the group's list of non-empty subqueues.
+      /*!
+       * Does nothing if @a q isn't in the list.
+       */
+      void
+      remove_from_active_list( group_t & group, demand_queue_t & q ) noexcept
+         {
+            demand_queue_t * prev{ nullptr };
+            for( auto * current = group.m_head; current;
+                  current = current->next() )
+               {
+                  if( current == &q )
+                     {
+                        if( !prev )
+                           {
+                              (void)pop_from_active_list( group );
+                              return;
+                           }
+
+                        prev->set_next( q.next() );
+                        if( group.m_tail == &q )
+                           group.m_tail = prev;
+
+                        q.drop_next();
+                        return;
+                     }
+
+                  prev = current;
+               }
+         }
+
+      //! Adds @a q to the list of deferred subqueues.
+      void
+      append_to_deferred_list(
+         group_t & group,
+         demand_queue_t & q,
+         std::chrono::steady_clock::time_point ready_at )
+         {
+            m_deferred_queues.push_back( { ready_at, &group, &q } );
+            q.set_deferred( true );
+         }
+
+      //! Removes @a q from the list of deferred subqueues.
+      void
+      remove_from_deferred_list( demand_queue_t & q ) noexcept
+         {
+            const auto it = std::find_if(
+                  m_deferred_queues.begin(), m_deferred_queues.end(),
+                  [&q]( const deferred_queue_t & d ) { return d.m_queue == &q; } );
+            if( it != m_deferred_queues.end() )
+               m_deferred_queues.erase( it );
+
+            q.set_deferred( false );
+         }
+
+      //! Removes @a q from the group's list of non-empty subqueues or
+      //! from the list of deferred subqueues.
+      void
+      deactivate( group_t & group, demand_queue_t & q ) noexcept
+         {
+            if( q.is_deferred() )
+               remove_from_deferred_list( q );
+            else
+               remove_from_active_list( group, q );
+         }
+
+      //! Returns deferred subqueues those time has come to the lists
+      //! of non-empty subqueues.
+      void
+      activate_ready_deferred_queues() noexcept
+         {
+            if( m_deferred_queues.empty() )
+               return;
+
+            const auto now = std::chrono::steady_clock::now();
+            const auto it = std::stable_partition(
+                  m_deferred_queues.begin(), m_deferred_queues.end(),
+                  [now]( const deferred_queue_t & d ) {
+                     return d.m_ready_at > now;
+                  } );
+            for( auto i = it; i != m_deferred_queues.end(); ++i )
+               {
+                  i->m_queue->set_deferred( false );
+                  append_to_active_list( *(i->m_group), *(i->m_queue) );
+               }
+            m_deferred_queues.erase( it, m_deferred_queues.end() );
+         }
+
+      //! Returns the time point when the first deferred subqueue
+      //! should be checked.
+      [[nodiscard]]
+      std::optional< std::chrono::steady_clock::time_point >
+      nearest_deferred_time() const noexcept
+         {
+            const auto it = std::min_element(
+                  m_deferred_queues.begin(), m_deferred_queues.end(),
+                  []( const deferred_queue_t & a, const deferred_queue_t & b ) {
+                     return a.m_ready_at < b.m_ready_at;
+                  } );
+            if( it == m_deferred_queues.end() )
+               return std::nullopt;
+
+            return it->m_ready_at;
+         }
+
       /*!
-       * The tail of queue of non-empty subqueues.
+       * Wakes up producers blocked by backpressure if @a q is drained
+       * below the low watermark of some of them.
        *
-       * It is used for quick addition of new subqueue to the
-       * list of non-empty subqueues.
+       * @attention
+       * Must be called with m_lock acquired.
+       */
+      void
+      notify_backpressure_waiters( const demand_queue_t & q ) noexcept
+         {
+            for( const auto & w : m_backpressure_waiters )
+               if( w.m_queue == &q && q.size() <= w.m_low_watermark )
+                  {
+                     m_space_cv.notify_all();
+                     return;
+                  }
+         }
+
+      //! Returns a non-empty group with the smallest virtual time.
+      /*!
+       * Returns nullptr if there is no non-empty groups.
        */
-      demand_queue_t * m_tail{ nullptr };
+      [[nodiscard]]
+      group_t *
+      select_group() noexcept
+         {
+            group_t * result{ nullptr };
+            for( auto & g : m_groups )
+               if( g.m_head &&
+                     ( !result || g.m_virtual_time < result->m_virtual_time ) )
+                  result = &g;
+
+            return result;
+         }
+
+      //! Returns a group with @a name or nullptr if it isn't found.
+      [[nodiscard]]
+      group_t *
+      find_group( std::string_view name ) noexcept
+         {
+            const auto it = std::find_if( m_groups.begin(), m_groups.end(),
+                  [name]( const group_t & g ) { return name == g.m_name; } );
+            return it != m_groups.end() ? &(*it) : nullptr;
+         }
    };
 
 using dispatcher_data_shptr_t =
@@ -55,52 +652,420 @@ using dispatcher_data_shptr_t =
  * If demand_queue was empty before the addition then includes this
  * demand_queue into dispatcher's list of non-empty subqueues and
  * wakes the dispatcher up.
+ *
+ * Demands pushed from the dispatcher's worker thread are collected
+ * without locking and are added to demand_queue later by the worker
+ * thread itself.
  */
 class actual_event_queue_t final : public so_5::event_queue_t
    {
+      /*!
+       * The current demand_queue.
+       *
+       * @attention
+       * It's changed only by the worker thread with the dispatcher's
+       * lock acquired. So it can be read by the worker thread without
+       * the lock, but other threads have to acquire the lock.
+       */
       demand_queue_shptr_t m_demand_queue;
       dispatcher_data_shptr_t m_disp_data;
+      dispatcher_data_t::group_t & m_group;
+
+      //! It's cleared when the event_queue is destroyed.
+      const dispatcher_data_t::event_queue_lifetime_shptr_t m_lifetime;
+
+      //! Watermarks for backpressure (0 means that it's turned off).
+      const std::size_t m_high_watermark;
+      const std::size_t m_low_watermark;
+      const std::optional< std::chrono::steady_clock::duration >
+            m_backpressure_timeout;
+
+      [[nodiscard]]
+      bool
+      should_wait_for_space(
+         const so_5::execution_demand_t & demand ) const noexcept
+         {
+            // evt_start and evt_finish are pushed by SObjectizer itself
+            // and they are never delayed.
+            return 0u != m_high_watermark &&
+                  so_5::agent_t::get_demand_handler_on_start_ptr()
+                        != demand.m_demand_handler &&
+                  so_5::agent_t::get_demand_handler_on_finish_ptr()
+                        != demand.m_demand_handler &&
+                  m_demand_queue->size() >= m_high_watermark;
+         }
+
+      /*!
+       * Returns the count of demands that can be pushed before the
+       * demand_queue reaches the high watermark.
+       *
+       * It returns at least 1, because evt_start and evt_finish are
+       * pushed regardless of the watermark.
+       */
+      [[nodiscard]]
+      std::size_t
+      space_before_high_watermark() const noexcept
+         {
+            if( 0u == m_high_watermark )
+               return std::numeric_limits< std::size_t >::max();
+
+            const auto size = m_demand_queue->size();
+            return size < m_high_watermark ? m_high_watermark - size : 1u;
+         }
+
+      /*!
+       * Blocks the caller until the worker thread drains the
+       * demand_queue to the low watermark.
+       *
+       * The dispatcher's lock is released during the wait.
+       *
+       * Throws backpressure_timeout_t if the timeout is set and
+       * it is elapsed.
+       */
+      void
+      wait_for_space( std::unique_lock< std::mutex > & lock )
+         {
+            std::optional< std::chrono::steady_clock::time_point > deadline;
+            if( m_backpressure_timeout )
+               deadline = std::chrono::steady_clock::now() +
+                     *m_backpressure_timeout;
+
+            auto & waiters = m_disp_data->m_backpressure_waiters;
+            do
+               {
+                  // NOTE: demand_queue can be replaced during the wait,
+                  // so the waiter is registered again on every iteration.
+                  const dispatcher_data_t::backpressure_waiter_t me{
+                        m_demand_queue.get(), m_low_watermark };
+                  waiters.push_back( me );
+
+                  bool timed_out{ false };
+                  if( deadline )
+                     timed_out = std::cv_status::timeout ==
+                           m_disp_data->m_space_cv.wait_until( lock, *deadline );
+                  else
+                     m_disp_data->m_space_cv.wait( lock );
+
+                  waiters.erase( std::find_if( waiters.begin(), waiters.end(),
+                        [&me]( const auto & w ) {
+                           return w.m_queue == me.m_queue &&
+                                 w.m_low_watermark == me.m_low_watermark;
+                        } ) );
+
+                  if( timed_out &&
+                        m_demand_queue->size() > m_low_watermark )
+                     throw backpressure_timeout_t{
+                           "demand_queue is still full after "
+                           "backpressure timeout" };
+               }
+            while( m_demand_queue->size() > m_low_watermark );
+         }
 
    public:
       actual_event_queue_t(
          demand_queue_shptr_t demand_queue,
-         dispatcher_data_shptr_t disp_data ) noexcept
+         dispatcher_data_shptr_t disp_data,
+         dispatcher_data_t::group_t & group,
+         const binder_params_t & params )
          :  m_demand_queue{ std::move(demand_queue) }
          ,  m_disp_data{ std::move(disp_data) }
+         ,  m_group{ group }
+         ,  m_lifetime{
+               std::make_shared< dispatcher_data_t::event_queue_lifetime_t >() }
+         ,  m_high_watermark{ params.high_watermark() }
+         ,  m_low_watermark{ params.low_watermark() }
+         ,  m_backpressure_timeout{ params.backpressure_timeout() }
          {}
 
+      ~actual_event_queue_t()
+         {
+            // Demands staged for this event_queue and pending
+            // replacements of its demand_queue have to be ignored
+            // by the worker thread from now.
+            std::lock_guard< std::mutex > lock{ m_disp_data->m_lock };
+            m_lifetime->m_alive = false;
+         }
+
+      [[nodiscard]]
+      const dispatcher_data_shptr_t &
+      disp_data() const noexcept { return m_disp_data; }
+
+      [[nodiscard]]
+      const dispatcher_data_t::event_queue_lifetime_shptr_t &
+      lifetime() const noexcept { return m_lifetime; }
+
+      /*!
+       * Replaces the current demand_queue by @a new_queue.
+       *
+       * All demands from the current demand_queue are moved to
+       * @a new_queue in the order of their extraction by
+       * demand_queue_t::extract_for_migration().
+       *
+       * If @a new_queue throws on push() or the current demand_queue
+       * doesn't give all its demands away, the replacement is cancelled.
+       * Demands are returned to the current demand_queue and the failure
+       * is reported to SObjectizer's error_logger.
+       *
+       * @attention
+       * Must be called on the worker thread with the dispatcher's
+       * lock acquired.
+       */
+      void
+      change_demand_queue( demand_queue_shptr_t new_queue ) noexcept
+         {
+            auto & old_queue = *m_demand_queue;
+            m_disp_data->deactivate( m_group, old_queue );
+
+            const bool new_queue_was_empty = new_queue->empty();
+
+            // The demand that is being moved. It's kept here until
+            // the new queue accepts it.
+            std::optional< so_5::execution_demand_t > demand;
+            try
+               {
+                  while( !old_queue.empty() )
+                     {
+                        demand = old_queue.extract_for_migration();
+                        if( !demand )
+                           throw std::runtime_error(
+                                 "extract_for_migration() returns nothing "
+                                 "for non-empty demand_queue" );
+
+                        // A copy is pushed, the demand has to stay
+                        // here if push() throws.
+                        new_queue->push( *demand );
+                        demand.reset();
+                     }
+               }
+            catch( ... )
+               {
+                  m_disp_data->log_error( __FILE__, __LINE__, [] {
+                        return "replacement of demand_queue is cancelled: " +
+                              current_exception_description();
+                     } );
+
+                  return_demands( *new_queue, std::move(demand), old_queue );
+                  (void)m_disp_data->activate_after_push(
+                        m_group, old_queue, true );
+                  return;
+               }
+
+            m_demand_queue = std::move(new_queue);
+            (void)m_disp_data->activate_after_push(
+                  m_group, *m_demand_queue, new_queue_was_empty );
+
+            // Blocked producers have to recheck the new queue.
+            if( !m_disp_data->m_backpressure_waiters.empty() )
+               m_disp_data->m_space_cv.notify_all();
+         }
+
+      /*!
+       * Returns demands moved to @a new_queue back to @a old_queue
+       * after the failure of the replacement.
+       *
+       * Demands from @a new_queue go first, then @a in_flight, then
+       * demands that are still in @a old_queue. The original order
+       * is preserved if @a old_queue gives all its demands away.
+       */
+      void
+      return_demands(
+         demand_queue_t & new_queue,
+         std::optional< so_5::execution_demand_t > in_flight,
+         demand_queue_t & old_queue ) noexcept
+         {
+            try
+               {
+                  std::vector< so_5::execution_demand_t > demands;
+                  const auto take_all = [&demands]( demand_queue_t & q ) {
+                        while( !q.empty() )
+                           {
+                              auto d = q.extract_for_migration();
+                              if( !d )
+                                 break;
+                              demands.push_back( std::move(*d) );
+                           }
+                     };
+
+                  take_all( new_queue );
+                  if( in_flight )
+                     demands.push_back( std::move(*in_flight) );
+                  take_all( old_queue );
+
+                  for( auto & d : demands )
+                     old_queue.push( std::move(d) );
+               }
+            catch( ... )
+               {
+                  m_disp_data->log_error( __FILE__, __LINE__, [] {
+                        return "demands are lost during the cancellation "
+                              "of demand_queue replacement: " +
+                              current_exception_description();
+                     } );
+               }
+         }
+
       void
       push( so_5::execution_demand_t demand ) override
          {
-            std::lock_guard< std::mutex > lock{ m_disp_data->m_lock };
+            if( so_5::query_current_thread_id() ==
+                  m_disp_data->m_worker_thread_id.load(
+                        std::memory_order_relaxed ) )
+               {
+                  CQD_DEMAND_PROBE( demand_staged, m_demand_queue.get(), demand );
 
-            auto & q = *m_demand_queue;
-            const bool queue_was_empty = q.empty();
-            q.push( std::move(demand) );
+                  if( m_disp_data->m_recorder )
+                     m_disp_data->m_recorder->demand_enqueued(
+                           *m_demand_queue, demand );
 
-            if( queue_was_empty )
+                  // An agent sends a message to itself or to an agent
+                  // from the same dispatcher. The dispatcher's lock
+                  // isn't necessary in that case, the demand will be
+                  // moved to the queue before the next extraction.
+                  m_disp_data->m_staged_demands.push_back( {
+                        &m_group,
+                        m_demand_queue.get(),
+                        m_lifetime,
+                        std::move(demand) } );
+                  return;
+               }
+
+            std::unique_lock< std::mutex > lock{ m_disp_data->m_lock };
+
+            if( should_wait_for_space( demand ) )
+               wait_for_space( lock );
+
+            if( m_disp_data->m_recorder )
+               m_disp_data->m_recorder->demand_enqueued(
+                     *m_demand_queue, demand );
+
+            CQD_DEMAND_PROBE( demand_pushed, m_demand_queue.get(), demand );
+
+            // Only pointers are used by the probe, they stay valid
+            // after the demand is moved.
+            [[maybe_unused]] const auto * receiver = demand.m_receiver;
+            [[maybe_unused]] const auto msg_type = demand.m_msg_type;
+
+            if( m_disp_data->push_to_subqueue(
+                  m_group, *m_demand_queue, std::move(demand) ) )
                {
-                  // The following block of code shouldn't throw.
-                  [&]() noexcept {
-                     const bool disp_was_sleeping =
-                           (nullptr == m_disp_data->m_head);
+                  CQD_PROBE3( worker_wakeup,
+                        static_cast< const void * >( m_demand_queue.get() ),
+                        static_cast< const void * >( receiver ),
+                        msg_type.name() );
+                  m_disp_data->wake_up();
+               }
+         }
 
-                     if( disp_was_sleeping )
-                        {
-                           m_disp_data->m_head = m_disp_data->m_tail = &q;
+      /*!
+       * Pushes demands from [@a first, @a last) with one acquisition
+       * of the dispatcher's lock and at most one wakeup of the worker.
+       *
+       * Demands are moved from the range.
+       *
+       * @note
+       * If backpressure is turned on, the batch is pushed by chunks
+       * those fit below the high watermark. The caller waits for space
+       * before every chunk (the lock is released during the wait and
+       * the worker can be woken up once per chunk). If the wait fails,
+       * backpressure_timeout_t holds the count of pushed demands.
+       */
+      void
+      push_batch(
+         so_5::execution_demand_t * first,
+         so_5::execution_demand_t * last )
+         {
+            if( first == last )
+               return;
 
-                           m_disp_data->m_wakeup_cv.notify_one();
-                        }
-                     else
-                        {
-                           m_disp_data->m_tail->set_next( &q );
-                           m_disp_data->m_tail = &q;
-                        }
-                  }();
+            if( so_5::query_current_thread_id() ==
+                  m_disp_data->m_worker_thread_id.load(
+                        std::memory_order_relaxed ) )
+               {
+                  // The same reasons as for push() above.
+                  for( ; first != last; ++first )
+                     push( std::move(*first) );
+                  return;
                }
 
-            //NOTE: if the queue wasn't empty it is already in active queue.
-            //So there is no need to modity active queue.
+            const auto * const batch_first = first;
+
+            std::unique_lock< std::mutex > lock{ m_disp_data->m_lock };
+
+            while( first != last )
+               {
+                  if( should_wait_for_space( *first ) )
+                     {
+                        try
+                           {
+                              wait_for_space( lock );
+                           }
+                        catch( const backpressure_timeout_t & x )
+                           {
+                              // The caller has to know what is pushed.
+                              throw backpressure_timeout_t{
+                                    x.what(),
+                                    static_cast< std::size_t >(
+                                          first - batch_first ) };
+                           }
+                     }
+
+                  // NOTE: demand_queue can be replaced during the wait,
+                  // so it's read after the wait.
+                  const auto chunk_last = first + static_cast< std::ptrdiff_t >(
+                        std::min< std::size_t >(
+                              static_cast< std::size_t >( last - first ),
+                              space_before_high_watermark() ) );
+
+                  push_chunk( first, chunk_last );
+                  first = chunk_last;
+               }
+         }
+
+   private:
+      //! Pushes a part of a batch.
+      /*!
+       * @attention
+       * Must be called with the dispatcher's lock acquired.
+       */
+      void
+      push_chunk(
+         so_5::execution_demand_t * first,
+         so_5::execution_demand_t * last )
+         {
+            [[maybe_unused]] const auto * receiver = first->m_receiver;
+            [[maybe_unused]] const auto msg_type = first->m_msg_type;
+
+            const bool need_wakeup = m_disp_data->push_batch_to_subqueue(
+                  m_group, *m_demand_queue, first, last );
+
+            // Demands are recorded only when they are stored. The recorder
+            // and probes don't use messages, so moved-from demands
+            // can be passed to them.
+            for( auto it = first; it != last; ++it )
+               {
+                  if( m_disp_data->m_recorder )
+                     {
+                        // The worker has to be woken up even if
+                        // the recorder fails.
+                        try
+                           {
+                              m_disp_data->m_recorder->demand_enqueued(
+                                    *m_demand_queue, *it );
+                           }
+                        catch( ... ) {}
+                     }
+
+                  CQD_DEMAND_PROBE( demand_pushed, m_demand_queue.get(), *it );
+               }
+
+            if( need_wakeup )
+               {
+                  CQD_PROBE3( worker_wakeup,
+                        static_cast< const void * >( m_demand_queue.get() ),
+                        static_cast< const void * >( receiver ),
+                        msg_type.name() );
+                  m_disp_data->wake_up();
+               }
          }
    };
 
@@ -115,6 +1080,10 @@ class actual_event_queue_t final : public so_5::event_queue_t
  *
  * The only bind() method has an actual implementation, all other
  * inherited methods are left empty intentionally.
+ *
+ * @note
+ * Binder's demand_queue can be replaced at run-time, see
+ * dispatcher_t::change_demand_queue().
  */
 class actual_disp_binder_t final : public so_5::disp_binder_t
    {
@@ -123,10 +1092,17 @@ class actual_disp_binder_t final : public so_5::disp_binder_t
    public:
       actual_disp_binder_t(
          demand_queue_shptr_t demand_queue,
-         dispatcher_data_shptr_t disp_data ) noexcept
-         :  m_event_queue{ std::move(demand_queue), std::move(disp_data) }
+         dispatcher_data_shptr_t disp_data,
+         dispatcher_data_t::group_t & group,
+         const binder_params_t & params )
+         :  m_event_queue{
+               std::move(demand_queue), std::move(disp_data), group, params }
          {}
 
+      [[nodiscard]]
+      actual_event_queue_t &
+      event_queue() noexcept { return m_event_queue; }
+
       void
       preallocate_resources(
          so_5::agent_t & /*agent*/ ) override
@@ -156,18 +1132,73 @@ class actual_disp_binder_t final : public so_5::disp_binder_t
 /*!
  * The actual implementation of one_thread dispatcher.
  *
- * The dispatcher uses a separate thread for serving demands of
- * agents bound to the dispatcher.
- *
+ * In the dedicated thread mode the dispatcher uses a separate thread
+ * for serving demands of agents bound to the dispatcher.
  * The dispatcher starts its work in the constructor and finishes
  * it in the destructor.
+ *
+ * In the caller-driven mode the dispatcher has no thread. Demands are
+ * served by a user's thread inside run_available().
  */
 class dispatcher_t final
    :  public std::enable_shared_from_this< dispatcher_t >
    {
       dispatcher_data_t m_disp_data;
 
-      std::thread m_worker_thread;
+      std::thread m_worker_thread;
+
+#if defined(__linux__)
+      /*!
+       * The worker thread with SCHED_RR policy.
+       *
+       * std::thread doesn't allow to set the scheduling policy before
+       * the start of a thread. So such worker is created by
+       * pthread_create() and m_worker_thread isn't used.
+       */
+      std::optional< pthread_t > m_prioritized_worker_thread;
+#endif
+
+      /*!
+       * The group of the last executed demand and the CPU time
+       * consumed by its handler.
+       *
+       * CPU time is added to the group's statistics when the
+       * dispatcher's lock is acquired next time.
+       *
+       * @note
+       * Those values are accessed only by the worker thread.
+       */
+      dispatcher_data_t::group_t * m_last_group{ nullptr };
+      std::chrono::nanoseconds m_last_cpu_time{};
+
+      //! Optional watchdog for long demands.
+      watchdog::watchdog_shptr_t m_watchdog;
+      //! Watchdog's slot for the worker thread.
+      /*!
+       * nullptr if there is no watchdog.
+       */
+      watchdog::watchdog_t::slot_t * m_watchdog_slot{ nullptr };
+
+      //! Sets the ID of the worker thread for the caller-driven mode.
+      class worker_thread_id_setter_t
+         {
+            dispatcher_data_t & m_disp_data;
+
+         public:
+            worker_thread_id_setter_t( dispatcher_data_t & disp_data ) noexcept
+               :  m_disp_data{ disp_data }
+               {
+                  m_disp_data.m_worker_thread_id.store(
+                        so_5::query_current_thread_id(),
+                        std::memory_order_relaxed );
+               }
+            ~worker_thread_id_setter_t()
+               {
+                  m_disp_data.m_worker_thread_id.store(
+                        so_5::current_thread_id_t{},
+                        std::memory_order_relaxed );
+               }
+         };
 
       void
       thread_body() noexcept
@@ -192,24 +1223,35 @@ class dispatcher_t final
          {
             do
                {
-                  auto [demand, has_non_empty_queues] =
+                  prepare_for_extraction();
+
+                  auto [demand, has_non_empty_queues, group, queue] =
                         try_extract_demand_to_execute();
                   if( demand )
                      {
                         // Demand should be executed with unblocked
                         // dispatcher's lock.
                         unique_lock.unlock();
-                        demand->call_handler( thread_id );
+                        m_last_group = group;
+                        m_last_cpu_time = call_handler(
+                              thread_id, *demand, queue );
 
                         // Loop should be stopped after the execution
                         // of the demand.
                         break;
                      }
-                  else if( !has_non_empty_queues )
+                  else if( !has_non_empty_queues && !m_disp_data.m_shutdown )
                      {
                         // Should wait while something will be pushed
-                        // into the list, or shutdown flag will be set.
-                        m_disp_data.m_wakeup_cv.wait( unique_lock );
+                        // into the list, or shutdown flag will be set,
+                        // or the time of a deferred subqueue comes.
+                        CQD_PROBE1( worker_wait,
+                              m_disp_data.m_deferred_queues.size() );
+                        if( const auto t = m_disp_data.nearest_deferred_time() )
+                           m_disp_data.m_wakeup_cv.wait_until( unique_lock, *t );
+                        else
+                           m_disp_data.m_wakeup_cv.wait( unique_lock );
+                        CQD_PROBE0( worker_woken );
                      }
                }
             while( !m_disp_data.m_shutdown );
@@ -218,79 +1260,620 @@ class dispatcher_t final
          }
 
       /*!
-       * Return a tuple with two values:
+       * Handles all information collected since the previous extraction.
+       *
+       * @attention
+       * Must be called with m_disp_data.m_lock acquired.
+       */
+      void
+      prepare_for_extraction() noexcept
+         {
+            account_last_demand();
+            merge_staged_demands();
+            apply_queue_changes();
+            m_disp_data.activate_ready_deferred_queues();
+         }
+
+      //! Returns the CPU time consumed by the handler.
+      [[nodiscard]]
+      std::chrono::nanoseconds
+      call_handler(
+         so_5::current_thread_id_t thread_id,
+         so_5::execution_demand_t & demand,
+         [[maybe_unused]] const demand_queue_t * queue ) noexcept
+         {
+            if( m_watchdog_slot )
+               m_watchdog_slot->demand_started( demand );
+
+            // Demand can be modified by the handler, so the description
+            // is taken before the call.
+            [[maybe_unused]] const auto * receiver = demand.m_receiver;
+            [[maybe_unused]] const auto msg_type = demand.m_msg_type;
+
+            CQD_DEMAND_PROBE( handler_start, queue, demand );
+            const auto started_at = std::chrono::steady_clock::now();
+            const auto cpu_time_at_start = thread_cpu_time();
+            demand.call_handler( thread_id );
+            const auto cpu_time = thread_cpu_time() - cpu_time_at_start;
+            const auto duration =
+                  std::chrono::steady_clock::now() - started_at;
+            CQD_PROBE4( handler_finish,
+                  static_cast< const void * >( queue ),
+                  static_cast< const void * >( receiver ),
+                  msg_type.name(),
+                  static_cast< std::uint64_t >(
+                        std::chrono::duration_cast< std::chrono::nanoseconds >(
+                              duration ).count() ) );
+
+            if( m_watchdog_slot )
+               m_watchdog_slot->demand_finished();
+
+            if( m_disp_data.m_recorder )
+               {
+                  // There is nothing to do if recorder fails.
+                  try
+                     {
+                        m_disp_data.m_recorder->demand_handled(
+                              demand, duration );
+                     }
+                  catch( ... ) {}
+               }
+
+            return cpu_time;
+         }
+
+      /*!
+       * Updates statistics and virtual time of the group of the
+       * last executed demand.
+       *
+       * @attention
+       * Must be called with m_disp_data.m_lock acquired.
+       */
+      void
+      account_last_demand() noexcept
+         {
+            if( !m_last_group )
+               return;
+
+            auto & g = *m_last_group;
+            g.m_cpu_time += m_last_cpu_time;
+            ++g.m_demands_handled;
+            g.m_virtual_time += static_cast< double >(
+                  m_last_cpu_time.count() ) / g.m_weight;
+
+            m_last_group = nullptr;
+         }
+
+      /*!
+       * Moves demands pushed from the worker thread to their
+       * demand_queues.
+       *
+       * @attention
+       * Must be called with m_disp_data.m_lock acquired.
+       */
+      void
+      merge_staged_demands() noexcept
+         {
+            for( auto & sd : m_disp_data.m_staged_demands )
+               {
+                  // The binder is already destroyed. The demand can't
+                  // be handled anymore.
+                  if( !sd.m_lifetime->m_alive )
+                     continue;
+
+                  try
+                     {
+                        // There is no need to wake up the dispatcher
+                        // because it's the dispatcher who does the merge.
+                        (void)m_disp_data.push_to_subqueue(
+                              *sd.m_group, *sd.m_queue, std::move(sd.m_demand) );
+                     }
+                  catch( ... )
+                     {
+                        // The sender has already finished its work,
+                        // so the failure can only be logged.
+                        m_disp_data.log_error( __FILE__, __LINE__, [&] {
+                              return "demand pushed from the worker thread "
+                                    "is lost, demand_queue_t::push() failed: " +
+                                    current_exception_description() +
+                                    "; msg_type: " + sd.m_demand.m_msg_type.name();
+                           } );
+                     }
+               }
+
+            m_disp_data.m_staged_demands.clear();
+         }
+
+      /*!
+       * Performs replacements of demand_queues requested by
+       * change_demand_queue().
+       *
+       * @attention
+       * Must be called with m_disp_data.m_lock acquired.
+       */
+      void
+      apply_queue_changes() noexcept
+         {
+            for( auto & c : m_disp_data.m_queue_changes )
+               if( c.m_lifetime->m_alive )
+                  c.m_event_queue->change_demand_queue(
+                        std::move(c.m_new_queue) );
+
+            m_disp_data.m_queue_changes.clear();
+         }
+
+      /*!
+       * Return a tuple with three values:
        *
        * - the first is the result of demand_queue_t::try_extract() method
        *   called for a non-empty demand-queue;
        * - the second is the boolean flag that is set to `true` if there are
        *   at least one non-empty demand-queue. If this flag is `false` then
-       *   there is no non-empty demand-queues at all.
+       *   there is no non-empty demand-queues at all (except deferred ones);
+       * - the third is the group of demand-queue;
+       * - the fourth is the demand-queue.
        */
       [[nodiscard]]
-      std::tuple< std::optional< so_5::execution_demand_t >, bool >
+      std::tuple<
+            std::optional< so_5::execution_demand_t >,
+            bool,
+            dispatcher_data_t::group_t *,
+            const demand_queue_t * >
       try_extract_demand_to_execute() noexcept
          {
             std::optional< so_5::execution_demand_t > result;
 
-            bool has_non_empty_queues{ false };
+            auto * group = m_disp_data.select_group();
+            if( !group )
+               return { result, false, group, nullptr };
 
-            if( !m_disp_data.m_head )
-               return { result, has_non_empty_queues };
+            m_disp_data.m_virtual_time = group->m_virtual_time;
 
-            auto * dq = m_disp_data.m_head;
-            m_disp_data.m_head = dq->next();
-            dq->drop_next();
+            auto & dq = m_disp_data.pop_from_active_list( *group );
 
-            if( !m_disp_data.m_head )
-               m_disp_data.m_tail = nullptr;
+            result = dq.try_extract();
+            if( result )
+               CQD_DEMAND_PROBE( demand_extracted, &dq, *result );
             else
-               has_non_empty_queues = true;
+               CQD_PROBE1( extract_empty, static_cast< const void * >( &dq ) );
 
-            result = dq->try_extract();
+            if( result && !m_disp_data.m_backpressure_waiters.empty() )
+               m_disp_data.notify_backpressure_waiters( dq );
 
-            if( !dq->empty() )
+            if( result && m_disp_data.m_recorder )
                {
-                  // The current demand queue is not empty yet.
-                  // So it should be returned to the active queue.
-                  if( m_disp_data.m_tail )
+                  // There is nothing to do if recorder fails.
+                  try
                      {
-                        m_disp_data.m_tail->set_next( dq );
+                        m_disp_data.m_recorder->demand_dequeued(
+                              dq, *result );
                      }
-                  else
+                  catch( ... ) {}
+               }
+
+            if( !dq.empty() )
+               {
+                  // The current demand queue is not empty yet.
+                  // So it should be returned to the active queue,
+                  // or to the list of deferred queues if it has
+                  // no ready demands for some time.
+                  std::optional< std::chrono::steady_clock::time_point >
+                        ready_at;
+                  if( !result )
+                     ready_at = dq.ready_at();
+
+                  bool deferred{ false };
+                  if( ready_at &&
+                        *ready_at > std::chrono::steady_clock::now() )
                      {
-                        m_disp_data.m_head = m_disp_data.m_tail = dq;
+                        try
+                           {
+                              m_disp_data.append_to_deferred_list(
+                                    *group, dq, *ready_at );
+                              deferred = true;
+                           }
+                        catch( ... )
+                           {
+                              // The queue will be checked again soon.
+                           }
                      }
+
+                  if( !deferred )
+                     m_disp_data.append_to_active_list( *group, dq );
                }
 
-            return { result, has_non_empty_queues };
+            const bool has_non_empty_queues = 0u != m_disp_data.m_active_groups;
+
+            return { result, has_non_empty_queues, group, &dq };
+         }
+
+      /*!
+       * Checks that @a binder was created by this dispatcher.
+       *
+       * Throws if it isn't so.
+       */
+      [[nodiscard]]
+      std::shared_ptr< actual_disp_binder_t >
+      to_actual_binder( const so_5::disp_binder_shptr_t & binder ) const
+         {
+            auto actual_binder =
+                  std::dynamic_pointer_cast< actual_disp_binder_t >( binder );
+            if( !actual_binder ||
+                  actual_binder->event_queue().disp_data().get() != &m_disp_data )
+               throw std::runtime_error(
+                     "binder isn't created by this dispatcher" );
+
+            return actual_binder;
          }
 
    public:
-      dispatcher_t()
+      //! Mode of the dispatcher.
+      enum class work_mode_t
          {
-            m_worker_thread = std::thread{ [this]{ thread_body(); } };
+            //! The dispatcher creates and uses its own worker thread.
+            dedicated_thread,
+            //! Demands are served by the caller in run_available().
+            caller_driven
+         };
+
+      dispatcher_t(
+         so_5::environment_t & env,
+         disp_params_t params,
+         work_mode_t mode )
+         :  m_disp_data{ env }
+         {
+            m_disp_data.m_recorder = params.trace_recorder();
+
+            m_disp_data.m_groups.reserve(
+                  params.scheduling_groups().size() + 1u );
+            m_disp_data.m_groups.emplace_back(
+                  std::string{ default_group_name }, 1u );
+            for( const auto & [name, weight] : params.scheduling_groups() )
+               {
+                  if( !weight )
+                     throw std::runtime_error(
+                           "weight of scheduling group can't be 0: " + name );
+                  if( m_disp_data.find_group( name ) )
+                     throw std::runtime_error(
+                           "scheduling group is already defined: " + name );
+
+                  m_disp_data.m_groups.emplace_back( name, weight );
+               }
+
+            if( params.watchdog() )
+               {
+                  m_watchdog = params.watchdog();
+                  m_watchdog_slot = &m_watchdog->acquire_slot();
+               }
+
+            try
+               {
+                  start( mode, params.thread_priority() );
+               }
+            catch( ... )
+               {
+                  if( m_watchdog_slot )
+                     m_watchdog->release_slot( *m_watchdog_slot );
+                  throw;
+               }
          }
       ~dispatcher_t()
          {
+            stop();
+
+            if( m_watchdog_slot )
+               m_watchdog->release_slot( *m_watchdog_slot );
+         }
+
+   private:
+      void
+      start(
+         work_mode_t mode,
+         const std::optional< int > & thread_priority )
+         {
+            if( work_mode_t::caller_driven == mode )
+               {
+#if defined(__linux__)
+                  m_disp_data.m_event_fd = ::eventfd(
+                        0, EFD_CLOEXEC | EFD_NONBLOCK );
+                  if( -1 == m_disp_data.m_event_fd )
+                     throw std::system_error(
+                           errno, std::system_category(), "eventfd failed" );
+#endif
+                  return;
+               }
+
+#if defined(__linux__)
+            if( thread_priority )
+               {
+                  start_prioritized_thread( *thread_priority );
+                  return;
+               }
+#else
+            (void)thread_priority;
+#endif
+
+            m_worker_thread = std::thread{ [this]{ thread_body(); } };
+            // There is no binders yet, so no one can read that value
+            // at the moment.
+            m_disp_data.m_worker_thread_id.store(
+                  m_worker_thread.get_id(), std::memory_order_relaxed );
+         }
+
+#if defined(__linux__)
+      /*!
+       * Creates the worker thread with SCHED_RR policy and @a priority.
+       *
+       * The policy is set via attributes of the new thread, so there
+       * is no thread to stop if the policy can't be set.
+       */
+      void
+      start_prioritized_thread( int priority )
+         {
+            pthread_attr_t attr;
+            int rc = ::pthread_attr_init( &attr );
+            if( rc )
+               throw std::system_error(
+                     rc, std::system_category(), "pthread_attr_init failed" );
+
+            sched_param param{};
+            param.sched_priority = priority;
+
+            // The next call is made only if the previous one succeeded.
+            const char * failed_call = "pthread_attr_setinheritsched";
+            rc = ::pthread_attr_setinheritsched( &attr, PTHREAD_EXPLICIT_SCHED );
+            if( !rc )
+               {
+                  failed_call = "pthread_attr_setschedpolicy";
+                  rc = ::pthread_attr_setschedpolicy( &attr, SCHED_RR );
+               }
+            if( !rc )
+               {
+                  failed_call = "pthread_attr_setschedparam";
+                  rc = ::pthread_attr_setschedparam( &attr, &param );
+               }
+            pthread_t thread;
+            if( !rc )
+               {
+                  failed_call = "pthread_create";
+                  rc = ::pthread_create(
+                        &thread, &attr, &prioritized_thread_entry, this );
+               }
+            ::pthread_attr_destroy( &attr );
+
+            if( rc )
+               throw std::system_error( rc, std::system_category(),
+                     std::string{ failed_call } + " failed" );
+
+            m_prioritized_worker_thread = thread;
+         }
+
+      static void *
+      prioritized_thread_entry( void * arg ) noexcept
+         {
+            auto * self = static_cast< dispatcher_t * >( arg );
+            // The ID can't be taken from pthread_t. Demands can't be
+            // pushed by this thread before that store.
+            self->m_disp_data.m_worker_thread_id.store(
+                  so_5::query_current_thread_id(), std::memory_order_relaxed );
+            self->thread_body();
+            return nullptr;
+         }
+#endif
+
+      void
+      stop() noexcept
+         {
+#if defined(__linux__)
+            if( -1 != m_disp_data.m_event_fd )
+               {
+                  ::close( m_disp_data.m_event_fd );
+                  return;
+               }
+#endif
             {
                std::lock_guard< std::mutex > lock{ m_disp_data.m_lock };
                m_disp_data.m_shutdown = true;
                m_disp_data.m_wakeup_cv.notify_one();
             }
+
+#if defined(__linux__)
+            if( m_prioritized_worker_thread )
+               {
+                  ::pthread_join( *m_prioritized_worker_thread, nullptr );
+                  return;
+               }
+#endif
             m_worker_thread.join();
          }
 
+   public:
+#if defined(__linux__)
+      [[nodiscard]]
+      int
+      event_fd() const noexcept { return m_disp_data.m_event_fd; }
+
+      [[nodiscard]]
+      std::optional< std::chrono::steady_clock::time_point >
+      nearest_deferred_time()
+         {
+            std::lock_guard< std::mutex > lock{ m_disp_data.m_lock };
+            return m_disp_data.nearest_deferred_time();
+         }
+
+      /*!
+       * Serves demands on the caller's thread.
+       *
+       * Returns the count of handled demands.
+       */
+      [[nodiscard]]
+      std::size_t
+      run_available(
+         std::size_t max_demands,
+         std::chrono::steady_clock::time_point deadline )
+         {
+            if( -1 == m_disp_data.m_event_fd )
+               throw std::runtime_error(
+                     "run_available() can't be used for a dispatcher "
+                     "with the dedicated thread" );
+
+            const auto thread_id = so_5::query_current_thread_id();
+            // Demands pushed from handlers should go via the fast path.
+            worker_thread_id_setter_t id_setter{ m_disp_data };
+
+            std::size_t handled{};
+            // The first demand_queue that gave nothing since the last
+            // handled demand.
+            const demand_queue_t * first_failed_queue{ nullptr };
+            std::unique_lock< std::mutex > lock{ m_disp_data.m_lock };
+            while( handled < max_demands )
+               {
+                  prepare_for_extraction();
+
+                  auto [demand, has_non_empty_queues, group, queue] =
+                        try_extract_demand_to_execute();
+                  if( !demand )
+                     {
+                        // Other demand_queues can have ready demands.
+                        // If the same queue is selected again then all
+                        // non-empty queues were tried and there is nothing
+                        // to do at the moment. If there are some non-ready
+                        // demands the eventfd stays readable and the caller
+                        // will return here soon. Deferred demand_queues are
+                        // reported by next_ready_at().
+                        if( !has_non_empty_queues ||
+                              first_failed_queue == queue )
+                           break;
+
+                        if( !first_failed_queue )
+                           first_failed_queue = queue;
+                        continue;
+                     }
+
+                  first_failed_queue = nullptr;
+                  lock.unlock();
+                  m_last_group = group;
+                  m_last_cpu_time = call_handler(
+                        thread_id, *demand, queue );
+                  ++handled;
+                  lock.lock();
+
+                  if( std::chrono::steady_clock::now() >= deadline )
+                     break;
+               }
+
+            // Demands pushed from the last handler have to be moved to
+            // their queues before the update of the eventfd.
+            prepare_for_extraction();
+
+            if( 0u == m_disp_data.m_active_groups )
+               {
+                  std::uint64_t counter;
+                  // The eventfd is nonblocking and errors can be ignored.
+                  (void)::read( m_disp_data.m_event_fd,
+                        &counter, sizeof(counter) );
+               }
+
+            return handled;
+         }
+#endif
+
+      /*!
+       * Initiates the replacement of demand_queue for @a binder.
+       *
+       * The replacement will be performed by the worker thread before
+       * the next extraction of a demand.
+       *
+       * Throws if @a binder wasn't created by this dispatcher.
+       */
+      void
+      change_demand_queue(
+         const so_5::disp_binder_shptr_t & binder,
+         demand_queue_shptr_t new_queue )
+         {
+            if( !new_queue )
+               throw std::runtime_error( "new demand_queue is nullptr" );
+
+            // NOTE: actual_binder has to be released after the lock
+            // because the destructor of the binder acquires the lock.
+            auto actual_binder = to_actual_binder( binder );
+            auto & event_queue = actual_binder->event_queue();
+
+            std::lock_guard< std::mutex > lock{ m_disp_data.m_lock };
+            m_disp_data.m_queue_changes.push_back( {
+                  &event_queue,
+                  event_queue.lifetime(),
+                  std::move(new_queue) } );
+
+            m_disp_data.wake_up();
+         }
+
+      /*!
+       * Pushes a batch of demands to the demand_queue of @a binder.
+       *
+       * Throws if @a binder wasn't created by this dispatcher.
+       */
+      void
+      push_batch(
+         const so_5::disp_binder_shptr_t & binder,
+         so_5::execution_demand_t * first,
+         so_5::execution_demand_t * last )
+         {
+            to_actual_binder( binder )->event_queue().push_batch( first, last );
+         }
+
+      [[nodiscard]]
+      std::vector< group_stats_t >
+      query_group_stats()
+         {
+            std::vector< group_stats_t > result;
+            result.reserve( m_disp_data.m_groups.size() );
+
+            std::lock_guard< std::mutex > lock{ m_disp_data.m_lock };
+            for( const auto & g : m_disp_data.m_groups )
+               result.push_back( group_stats_t{
+                     g.m_name,
+                     g.m_weight,
+                     g.m_cpu_time,
+                     g.m_demands_handled
+                  } );
+
+            return result;
+         }
+
       [[nodiscard]]
       so_5::disp_binder_shptr_t
       make_disp_binder(
-         demand_queue_shptr_t demand_queue )
+         demand_queue_shptr_t demand_queue,
+         const binder_params_t & params )
          {
+            // The list of groups isn't changed, so it can be accessed
+            // without the lock.
+            auto * group = m_disp_data.find_group( params.scheduling_group() );
+            if( !group )
+               throw std::runtime_error(
+                     "unknown scheduling group: " + params.scheduling_group() );
+            if( params.high_watermark() &&
+                  params.low_watermark() >= params.high_watermark() )
+               throw std::runtime_error(
+                     "low watermark has to be less than high watermark" );
+#if defined(__linux__)
+            // There is no worker thread to drain the queue in the
+            // caller-driven mode.
+            if( params.high_watermark() && -1 != m_disp_data.m_event_fd )
+               throw std::runtime_error(
+                     "backpressure can't be used with caller-driven "
+                     "dispatcher" );
+#endif
+
             return std::make_shared< actual_disp_binder_t >(
                   std::move(demand_queue),
                   dispatcher_data_shptr_t{
                         shared_from_this(),
                         &m_disp_data
-                  } );
+                  },
+                  *group,
+                  params );
          }
    };
 
@@ -305,6 +1888,14 @@ class dispatcher_handle_maker_t
          {
             return { std::move(disp) };
          }
+
+#if defined(__linux__)
+      static caller_driven_dispatcher_handle_t
+      make_caller_driven( dispatcher_shptr_t disp ) noexcept
+         {
+            return { std::move(disp) };
+         }
+#endif
    };
 
 } /* namespace impl */
@@ -326,11 +1917,51 @@ dispatcher_handle_t::empty() const noexcept
 
 so_5::disp_binder_shptr_t
 dispatcher_handle_t::binder( demand_queue_shptr_t demand_queue ) const
+   {
+      return binder( std::move(demand_queue), binder_params_t{} );
+   }
+
+so_5::disp_binder_shptr_t
+dispatcher_handle_t::binder(
+   demand_queue_shptr_t demand_queue,
+   const binder_params_t & params ) const
+   {
+      if( !m_disp )
+         throw std::runtime_error( "empty dispatcher_handle" );
+
+      return m_disp->make_disp_binder( std::move(demand_queue), params );
+   }
+
+std::vector< group_stats_t >
+dispatcher_handle_t::query_group_stats() const
+   {
+      if( !m_disp )
+         throw std::runtime_error( "empty dispatcher_handle" );
+
+      return m_disp->query_group_stats();
+   }
+
+void
+dispatcher_handle_t::change_demand_queue(
+   const so_5::disp_binder_shptr_t & binder,
+   demand_queue_shptr_t new_queue ) const
+   {
+      if( !m_disp )
+         throw std::runtime_error( "empty dispatcher_handle" );
+
+      m_disp->change_demand_queue( binder, std::move(new_queue) );
+   }
+
+void
+dispatcher_handle_t::push_batch(
+   const so_5::disp_binder_shptr_t & binder,
+   so_5::execution_demand_t * first,
+   so_5::execution_demand_t * last ) const
    {
       if( !m_disp )
          throw std::runtime_error( "empty dispatcher_handle" );
 
-      return m_disp->make_disp_binder( std::move(demand_queue) );
+      m_disp->push_batch( binder, first, last );
    }
 
 void
@@ -344,13 +1975,80 @@ dispatcher_handle_t::reset() noexcept
 //
 dispatcher_handle_t
 make_dispatcher(
-   // NOTE: SOEnv is not used at that moment.
-   so_5::environment_t & /*env*/ )
+   so_5::environment_t & env )
+   {
+      return make_dispatcher( env, disp_params_t{} );
+   }
+
+dispatcher_handle_t
+make_dispatcher(
+   so_5::environment_t & env,
+   disp_params_t params )
    {
       return impl::dispatcher_handle_maker_t::make(
-            std::make_shared< impl::dispatcher_t >() );
+            std::make_shared< impl::dispatcher_t >(
+                  env,
+                  std::move(params),
+                  impl::dispatcher_t::work_mode_t::dedicated_thread ) );
+   }
+
+#if defined(__linux__)
+
+//
+// caller_driven_dispatcher_handle_t
+//
+
+caller_driven_dispatcher_handle_t::caller_driven_dispatcher_handle_t(
+   impl::dispatcher_shptr_t disp )
+   :  dispatcher_handle_t{ std::move(disp) }
+   {}
+
+int
+caller_driven_dispatcher_handle_t::event_fd() const
+   {
+      if( !m_disp )
+         throw std::runtime_error( "empty dispatcher_handle" );
+
+      return m_disp->event_fd();
+   }
+
+std::optional< std::chrono::steady_clock::time_point >
+caller_driven_dispatcher_handle_t::next_ready_at() const
+   {
+      if( !m_disp )
+         throw std::runtime_error( "empty dispatcher_handle" );
+
+      return m_disp->nearest_deferred_time();
+   }
+
+std::size_t
+caller_driven_dispatcher_handle_t::run_available(
+   std::size_t max_demands,
+   std::chrono::steady_clock::time_point deadline ) const
+   {
+      if( !m_disp )
+         throw std::runtime_error( "empty dispatcher_handle" );
+
+      return m_disp->run_available( max_demands, deadline );
+   }
+
+//
+// make_caller_driven_dispatcher
+//
+caller_driven_dispatcher_handle_t
+make_caller_driven_dispatcher(
+   so_5::environment_t & env,
+   disp_params_t params )
+   {
+      return impl::dispatcher_handle_maker_t::make_caller_driven(
+            std::make_shared< impl::dispatcher_t >(
+                  env,
+                  std::move(params),
+                  impl::dispatcher_t::work_mode_t::caller_driven ) );
    }
 
+#endif
+
 } /* namespace one_thread */
 
 } /* namespace custom_queue_disps */
@@ -1,6 +1,17 @@
 #pragma once
 
 #include <custom_queue_disps/demand_queue.hpp>
+#include <custom_queue_disps/trace.hpp>
+#include <custom_queue_disps/watchdog.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
 
 namespace custom_queue_disps
 {
@@ -19,6 +30,313 @@ class dispatcher_handle_maker_t;
 
 } /* namespace impl */
 
+//
+// default_group_name
+//
+/*!
+ * The name of the scheduling group that exists in every dispatcher.
+ *
+ * Binders that don't specify a scheduling group belong to that group.
+ * The weight of that group is 1.
+ */
+inline constexpr std::string_view default_group_name{ "default" };
+
+//
+// disp_params_t
+//
+/*!
+ * Optional parameters for one_thread dispatcher.
+ *
+ * Usage example:
+ * @code
+ * auto disp = custom_queue_disps::one_thread::make_dispatcher(env,
+ *    custom_queue_disps::one_thread::disp_params_t{}
+ *       .trace_recorder(my_recorder));
+ * @endcode
+ */
+class disp_params_t
+   {
+   public:
+      //! Type of container for names and weights of scheduling groups.
+      using scheduling_groups_t =
+            std::vector< std::pair< std::string, unsigned > >;
+
+   private:
+      trace::recorder_shptr_t m_trace_recorder;
+
+      scheduling_groups_t m_scheduling_groups;
+
+      watchdog::watchdog_shptr_t m_watchdog;
+
+      std::optional< int > m_thread_priority;
+
+   public:
+      disp_params_t() = default;
+
+      /*!
+       * Sets a recorder for demand's events.
+       *
+       * Recording is turned off by default.
+       */
+      disp_params_t &
+      trace_recorder( trace::recorder_shptr_t recorder )
+         {
+            m_trace_recorder = std::move(recorder);
+            return *this;
+         }
+
+      [[nodiscard]]
+      const trace::recorder_shptr_t &
+      trace_recorder() const noexcept { return m_trace_recorder; }
+
+      /*!
+       * Defines a new scheduling group.
+       *
+       * The dispatcher selects scheduling groups by weighted fair
+       * queuing: the CPU time consumed by handlers of a group
+       * is proportional to the group's @a weight (if all groups have
+       * demands to process, see group_stats_t::m_cpu_time). Subqueues inside a group are served in
+       * round-robin manner.
+       *
+       * Usage example:
+       * @code
+       * auto disp = custom_queue_disps::one_thread::make_dispatcher(env,
+       *    custom_queue_disps::one_thread::disp_params_t{}
+       *       .scheduling_group("gold", 6)
+       *       .scheduling_group("silver", 3));
+       * auto binder = disp.binder(std::make_shared<my_queue>(),
+       *    custom_queue_disps::one_thread::binder_params_t{}
+       *       .scheduling_group("gold"));
+       * @endcode
+       *
+       * @note
+       * The default group with weight 1 always exists, see
+       * default_group_name.
+       *
+       * @attention
+       * @a weight can't be 0 and @a name has to be unique. Otherwise
+       * make_dispatcher() throws.
+       */
+      disp_params_t &
+      scheduling_group( std::string name, unsigned weight )
+         {
+            m_scheduling_groups.emplace_back( std::move(name), weight );
+            return *this;
+         }
+
+      [[nodiscard]]
+      const scheduling_groups_t &
+      scheduling_groups() const noexcept { return m_scheduling_groups; }
+
+      /*!
+       * Sets a watchdog for demands that run too long.
+       *
+       * The watchdog is turned off by default.
+       */
+      disp_params_t &
+      watchdog( watchdog::watchdog_shptr_t wd )
+         {
+            m_watchdog = std::move(wd);
+            return *this;
+         }
+
+      [[nodiscard]]
+      const watchdog::watchdog_shptr_t &
+      watchdog() const noexcept { return m_watchdog; }
+
+      /*!
+       * Sets the OS scheduling priority for the worker thread.
+       *
+       * On Linux the worker thread gets SCHED_RR policy with @a priority
+       * (from 1 to 99, a bigger value means a higher priority). It usually
+       * requires CAP_SYS_NICE or an appropriate RLIMIT_RTPRIO, and
+       * make_dispatcher() throws if the priority can't be set.
+       *
+       * The priority is ignored on other platforms and in
+       * the caller-driven mode.
+       *
+       * The worker thread has the default priority by default.
+       */
+      disp_params_t &
+      thread_priority( int priority )
+         {
+            m_thread_priority = priority;
+            return *this;
+         }
+
+      [[nodiscard]]
+      const std::optional< int > &
+      thread_priority() const noexcept { return m_thread_priority; }
+   };
+
+//
+// backpressure_timeout_t
+//
+/*!
+ * An exception thrown from the sending of a message if the demand_queue
+ * is still full after the backpressure timeout.
+ *
+ * See binder_params_t::backpressure_timeout().
+ */
+class backpressure_timeout_t final : public std::runtime_error
+   {
+      std::size_t m_pushed;
+
+   public:
+      backpressure_timeout_t( const std::string & what, std::size_t pushed = 0u )
+         :  std::runtime_error{ what }
+         ,  m_pushed{ pushed }
+         {}
+
+      /*!
+       * The count of demands from the beginning of a batch that were
+       * pushed before the timeout (see dispatcher_handle_t::push_batch()).
+       *
+       * It's always 0 for an ordinary send.
+       */
+      [[nodiscard]]
+      std::size_t
+      pushed() const noexcept { return m_pushed; }
+   };
+
+//
+// binder_params_t
+//
+/*!
+ * Optional parameters for a binder.
+ */
+class binder_params_t
+   {
+      std::string m_scheduling_group{ default_group_name };
+
+      std::size_t m_high_watermark{};
+      std::size_t m_low_watermark{};
+      std::optional< std::chrono::steady_clock::duration > m_backpressure_timeout;
+
+   public:
+      binder_params_t() = default;
+
+      /*!
+       * Sets the scheduling group for the binder.
+       *
+       * The group should be defined by disp_params_t::scheduling_group().
+       */
+      binder_params_t &
+      scheduling_group( std::string name )
+         {
+            m_scheduling_group = std::move(name);
+            return *this;
+         }
+
+      [[nodiscard]]
+      const std::string &
+      scheduling_group() const noexcept { return m_scheduling_group; }
+
+      /*!
+       * Turns backpressure on.
+       *
+       * When the binder's demand_queue holds @a high_watermark demands
+       * (see demand_queue_t::size()) a sender of a new message is blocked
+       * until the worker thread drains the queue to @a low_watermark.
+       * The dispatcher's lock isn't held during the wait.
+       *
+       * Usage example:
+       * @code
+       * auto binder = disp.binder(std::make_shared<my_queue>(),
+       *    custom_queue_disps::one_thread::binder_params_t{}
+       *       .backpressure(10000, 5000)
+       *       .backpressure_timeout(std::chrono::milliseconds{100}));
+       * @endcode
+       *
+       * @note
+       * Messages sent from the worker thread of the same dispatcher
+       * aren't blocked, otherwise the worker can block itself. Demands for
+       * evt_start and evt_finish aren't blocked too.
+       *
+       * @attention
+       * The sender is blocked, so a sender that is an agent from another
+       * dispatcher blocks that dispatcher. It can lead to a deadlock if
+       * two dispatchers send to each other with backpressure. Delayed and
+       * periodic messages are sent from SObjectizer's timer thread: if
+       * such a send is blocked, every timer in the environment stalls.
+       *
+       * @attention
+       * @a low_watermark has to be less than @a high_watermark. Otherwise
+       * binder() throws.
+       *
+       * @attention
+       * Backpressure can't be used with a dispatcher created by
+       * make_caller_driven_dispatcher(), binder() throws. Such dispatcher
+       * has no worker thread: its queues are drained only inside
+       * run_available(), so the caller's thread would wait for itself
+       * when it sends outside of run_available().
+       */
+      binder_params_t &
+      backpressure( std::size_t high_watermark, std::size_t low_watermark )
+         {
+            m_high_watermark = high_watermark;
+            m_low_watermark = low_watermark;
+            return *this;
+         }
+
+      //! High watermark for backpressure. 0 if backpressure is turned off.
+      [[nodiscard]]
+      std::size_t
+      high_watermark() const noexcept { return m_high_watermark; }
+
+      [[nodiscard]]
+      std::size_t
+      low_watermark() const noexcept { return m_low_watermark; }
+
+      /*!
+       * Sets the max time a sender waits due to backpressure.
+       *
+       * If the queue isn't drained to the low watermark during
+       * that time, backpressure_timeout_t is thrown from the sending
+       * of message and the message is not delivered.
+       *
+       * A sender waits without a limit by default.
+       */
+      binder_params_t &
+      backpressure_timeout( std::chrono::steady_clock::duration timeout )
+         {
+            m_backpressure_timeout = timeout;
+            return *this;
+         }
+
+      [[nodiscard]]
+      const std::optional< std::chrono::steady_clock::duration > &
+      backpressure_timeout() const noexcept { return m_backpressure_timeout; }
+   };
+
+//
+// group_stats_t
+//
+/*!
+ * Run-time statistics for a scheduling group.
+ */
+struct group_stats_t
+   {
+      std::string m_name;
+      unsigned m_weight;
+
+      /*!
+       * The total CPU time consumed by handlers of the group.
+       *
+       * Weighted fair queuing of groups is based on that time.
+       *
+       * @note
+       * On Linux it's the CPU time of the worker thread
+       * (CLOCK_THREAD_CPUTIME_ID), so the time a handler is blocked
+       * isn't included. On other platforms it's measured by a steady
+       * clock and the time of blocking calls is included.
+       */
+      std::chrono::nanoseconds m_cpu_time;
+
+      //! The total count of handled demands.
+      std::uint64_t m_demands_handled;
+   };
+
 //
 // dispatcher_handle_t
 //
@@ -39,10 +357,13 @@ class [[nodiscard]] dispatcher_handle_t
    {
       friend class impl::dispatcher_handle_maker_t;
 
+   protected:
       impl::dispatcher_shptr_t m_disp;
 
       dispatcher_handle_t( impl::dispatcher_shptr_t disp );
 
+   private:
+
       [[nodiscard]]
       bool
       empty() const noexcept;
@@ -77,6 +398,130 @@ class [[nodiscard]] dispatcher_handle_t
       so_5::disp_binder_shptr_t
       binder( demand_queue_shptr_t demand_queue ) const;
 
+      /*!
+       * Creates and returns a binder that will use @a demand_queue
+       * with additional parameters.
+       *
+       * Throws if the scheduling group specified in @a params
+       * isn't defined.
+       */
+      [[nodiscard]]
+      so_5::disp_binder_shptr_t
+      binder(
+         demand_queue_shptr_t demand_queue,
+         const binder_params_t & params ) const;
+
+      /*!
+       * Replaces demand_queue for agents bound via @a binder by
+       * @a new_queue.
+       *
+       * The replacement is performed asynchronously by the dispatcher's
+       * worker thread before the extraction of the next demand. So the
+       * guarantee about single-threaded access to demand_queue is kept.
+       * All pending demands are moved from the old queue to @a new_queue
+       * in the order in which the old queue gives them away. New demands
+       * go to @a new_queue after the replacement.
+       *
+       * Usage example:
+       * @code
+       * auto disp = custom_queue_disps::one_thread::make_dispatcher(env);
+       * auto binder = disp.binder(std::make_shared<normal_queue>());
+       * ...
+       * // Switch to overload policy.
+       * disp.change_demand_queue(binder, std::make_shared<overload_queue>());
+       * @endcode
+       *
+       * @attention
+       * The old queue and @a new_queue should be used only by @a binder.
+       * Otherwise demands of other binders will be moved too.
+       *
+       * @note
+       * Demands are taken from the old queue by
+       * demand_queue_t::extract_for_migration(), so demands that aren't
+       * ready yet are moved too. If @a new_queue throws on push() or the
+       * old queue doesn't give all its demands away then the replacement
+       * is cancelled: demands stay in the old queue and the failure is
+       * reported to SObjectizer's error_logger.
+       *
+       * Throws if @a binder wasn't created by this dispatcher.
+       */
+      void
+      change_demand_queue(
+         const so_5::disp_binder_shptr_t & binder,
+         demand_queue_shptr_t new_queue ) const;
+
+      /*!
+       * Pushes demands from [@a first, @a last) to the demand_queue of
+       * @a binder with one acquisition of the dispatcher's lock and
+       * at most one wakeup of the worker thread (per chunk if
+       * backpressure is turned on, see below).
+       *
+       * It's intended for senders that deliver many messages in a row
+       * to agents bound via the same binder. Demands are moved from
+       * the range. They have to be created by the caller for agents
+       * bound via @a binder, for example:
+       * @code
+       * std::vector<so_5::execution_demand_t> demands;
+       * for(auto * agent : receivers)
+       *    demands.emplace_back(
+       *       agent,
+       *       nullptr, // No message limits.
+       *       agent->so_direct_mbox()->id(),
+       *       typeid(my_message),
+       *       so_5::message_ref_t{std::make_unique<my_message>(...)},
+       *       so_5::agent_t::get_demand_handler_on_message_ptr());
+       * disp.push_batch(binder, demands.data(), demands.data() + demands.size());
+       * @endcode
+       *
+       * @attention
+       * SObjectizer doesn't know about such demands. So the caller has
+       * to keep receivers of demands registered until their demands are
+       * handled. In particular, push_batch() must not be used for agents
+       * of a coop that is being deregistered: evt_finish can be handled
+       * before the pushed demands, and those demands will refer to
+       * destroyed agents.
+       *
+       * @note
+       * Message limits and delivery filters aren't applied to such
+       * demands.
+       *
+       * @note
+       * If backpressure is turned on (see binder_params_t::backpressure())
+       * the batch is pushed by chunks. Every chunk fits below the high
+       * watermark and the caller waits for space before every chunk like
+       * a caller of an ordinary send. So the lock is acquired and the
+       * worker thread can be woken up once per chunk, and the queue doesn't
+       * exceed the high watermark.
+       *
+       * @note
+       * A batch can be pushed partially. If backpressure_timeout_t is
+       * thrown then demands [@a first, @a first + pushed()) are pushed
+       * (and moved from) and the rest of the range is left untouched,
+       * so it can be pushed again. If the demand_queue throws then
+       * demands of previous chunks are pushed and the demands of
+       * the failed chunk are handled as described for
+       * demand_queue_t::push_batch().
+       *
+       * @note
+       * demand_queue_t::push_batch() is used for storing of demands.
+       *
+       * Throws if @a binder wasn't created by this dispatcher.
+       */
+      void
+      push_batch(
+         const so_5::disp_binder_shptr_t & binder,
+         so_5::execution_demand_t * first,
+         so_5::execution_demand_t * last ) const;
+
+      /*!
+       * Returns the current statistics for all scheduling groups.
+       *
+       * The default group is always the first item.
+       */
+      [[nodiscard]]
+      std::vector< group_stats_t >
+      query_group_stats() const;
+
       /*!
        * Returns true if dispatcher_handler is not empty and holds
        * a reference to the dispatcher.
@@ -125,6 +570,126 @@ dispatcher_handle_t
 make_dispatcher(
    so_5::environment_t & env );
 
+/*!
+ * Creates and returns a new instance of one_thread dispatcher
+ * with additional parameters.
+ *
+ * Usage example:
+ * @code
+ * auto disp = custom_queue_disps::one_thread::make_dispatcher(
+ *    coop.environment(),
+ *    custom_queue_disps::one_thread::disp_params_t{}
+ *       .trace_recorder(
+ *          std::make_shared<custom_queue_disps::trace::recorder_t>(
+ *             "demands.cqdtrace")));
+ * @endcode
+ */
+[[nodiscard]]
+dispatcher_handle_t
+make_dispatcher(
+   so_5::environment_t & env,
+   disp_params_t params );
+
+#if defined(__linux__)
+
+//
+// caller_driven_dispatcher_handle_t
+//
+/*!
+ * A handle for a dispatcher that works in the caller-driven mode.
+ *
+ * Such dispatcher doesn't have its own thread. Demands are served
+ * inside run_available() on the caller's thread. The dispatcher provides
+ * an eventfd that is readable while there are demands to be served.
+ * So the dispatcher can be integrated into an existing epoll loop:
+ * @code
+ * auto disp = custom_queue_disps::one_thread::make_caller_driven_dispatcher(env);
+ * epoll_event ev{};
+ * ev.events = EPOLLIN;
+ * ev.data.fd = disp.event_fd();
+ * epoll_ctl(epfd, EPOLL_CTL_ADD, disp.event_fd(), &ev);
+ * ...
+ * // Inside the loop.
+ * if(disp.event_fd() == events[i].data.fd)
+ *    disp.run_available(64, std::chrono::steady_clock::now() + 1ms);
+ * @endcode
+ *
+ * @attention
+ * run_available() must not be called from several threads at the same
+ * time and must not be called from an event handler.
+ *
+ * @note
+ * This mode is available only on Linux.
+ */
+class [[nodiscard]] caller_driven_dispatcher_handle_t
+   :  public dispatcher_handle_t
+   {
+      friend class impl::dispatcher_handle_maker_t;
+
+      caller_driven_dispatcher_handle_t( impl::dispatcher_shptr_t disp );
+
+   public :
+      caller_driven_dispatcher_handle_t() noexcept = default;
+
+      /*!
+       * Returns the eventfd that is readable while the dispatcher
+       * has demands to be served.
+       *
+       * The eventfd is owned by the dispatcher and is closed when
+       * the dispatcher is destroyed.
+       */
+      [[nodiscard]]
+      int
+      event_fd() const;
+
+      /*!
+       * Returns the time point when a deferred demand_queue (see
+       * demand_queue_t::ready_at()) should be checked again.
+       *
+       * The eventfd doesn't become readable at that time, so the caller
+       * should use this value for the timeout of its epoll_wait()
+       * and call run_available() when the timeout expires.
+       */
+      [[nodiscard]]
+      std::optional< std::chrono::steady_clock::time_point >
+      next_ready_at() const;
+
+      /*!
+       * Serves available demands on the caller's thread.
+       *
+       * Returns when there are no more ready demands (all non-empty
+       * demand_queues have been tried without a result), or
+       * @a max_demands demands are handled, or @a deadline is reached.
+       * The @a deadline
+       * is checked after every handled demand, so at least one demand
+       * is handled if there is one.
+       *
+       * Returns the count of handled demands.
+       */
+      std::size_t
+      run_available(
+         std::size_t max_demands,
+         std::chrono::steady_clock::time_point deadline ) const;
+   };
+
+//
+// make_caller_driven_dispatcher
+//
+/*!
+ * Creates and returns a new instance of one_thread dispatcher
+ * that works in the caller-driven mode.
+ *
+ * @note
+ * This function is available only on Linux.
+ */
+[[nodiscard]]
+caller_driven_dispatcher_handle_t
+make_caller_driven_dispatcher(
+   so_5::environment_t & env,
+   disp_params_t params = disp_params_t{} );
+
+#endif
+
 } /* namespace one_thread */
 
 } /* namespace custom_queue_disps */
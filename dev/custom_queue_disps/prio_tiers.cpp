@@ -0,0 +1,162 @@
+#include <custom_queue_disps/prio_tiers.hpp>
+
+#include <atomic>
+#include <stdexcept>
+#include <string>
+
+namespace custom_queue_disps
+{
+
+namespace prio_tiers
+{
+
+namespace impl
+{
+
+//
+// dispatcher_t
+//
+/*!
+ * An implementation of prio_tiers dispatcher.
+ *
+ * Every tier is a set of one_thread dispatchers.
+ */
+class dispatcher_t final
+   {
+      struct tier_t
+         {
+            std::vector< one_thread::dispatcher_handle_t > m_threads;
+
+            //! The index of the thread for the next binder.
+            std::atomic< std::size_t > m_next{};
+
+            tier_t() = default;
+            tier_t( tier_t && o ) noexcept
+               :  m_threads{ std::move(o.m_threads) }
+               {}
+         };
+
+      std::vector< tier_t > m_tiers;
+
+   public:
+      dispatcher_t(
+         so_5::environment_t & env,
+         const disp_params_t & params )
+         {
+            if( params.tiers().empty() )
+               throw std::runtime_error( "prio_tiers dispatcher has no tiers" );
+
+            m_tiers.reserve( params.tiers().size() );
+            for( const auto & tp : params.tiers() )
+               {
+                  if( !tp.threads() )
+                     throw std::runtime_error(
+                           "count of threads for tier can't be 0" );
+
+                  tier_t & tier = m_tiers.emplace_back();
+                  tier.m_threads.reserve( tp.threads() );
+                  for( std::size_t i = 0u; i != tp.threads(); ++i )
+                     tier.m_threads.push_back(
+                           one_thread::make_dispatcher(
+                                 env, tp.thread_params() ) );
+               }
+         }
+
+      [[nodiscard]]
+      so_5::disp_binder_shptr_t
+      make_disp_binder(
+         demand_queue_shptr_t demand_queue,
+         std::size_t tier_index,
+         const one_thread::binder_params_t & params )
+         {
+            if( tier_index >= m_tiers.size() )
+               throw std::runtime_error(
+                     "unknown tier: " + std::to_string( tier_index ) );
+
+            auto & tier = m_tiers[ tier_index ];
+            const auto thread_index = tier.m_next.fetch_add(
+                  1u, std::memory_order_relaxed ) % tier.m_threads.size();
+
+            return tier.m_threads[ thread_index ].binder(
+                  std::move(demand_queue), params );
+         }
+
+      [[nodiscard]]
+      std::size_t
+      tiers_count() const noexcept { return m_tiers.size(); }
+   };
+
+//
+// dispatcher_handle_maker_t
+//
+class dispatcher_handle_maker_t
+   {
+   public :
+      static dispatcher_handle_t
+      make( dispatcher_shptr_t disp ) noexcept
+         {
+            return { std::move(disp) };
+         }
+   };
+
+} /* namespace impl */
+
+//
+// dispatcher_handle_t
+//
+dispatcher_handle_t::dispatcher_handle_t(
+   impl::dispatcher_shptr_t disp )
+   :  m_disp{ std::move(disp) }
+   {}
+
+so_5::disp_binder_shptr_t
+dispatcher_handle_t::binder(
+   demand_queue_shptr_t demand_queue,
+   std::size_t tier ) const
+   {
+      return binder( std::move(demand_queue), tier,
+            one_thread::binder_params_t{} );
+   }
+
+so_5::disp_binder_shptr_t
+dispatcher_handle_t::binder(
+   demand_queue_shptr_t demand_queue,
+   std::size_t tier,
+   const one_thread::binder_params_t & params ) const
+   {
+      if( !m_disp )
+         throw std::runtime_error( "empty dispatcher_handle" );
+
+      return m_disp->make_disp_binder( std::move(demand_queue), tier, params );
+   }
+
+std::size_t
+dispatcher_handle_t::tiers_count() const
+   {
+      if( !m_disp )
+         throw std::runtime_error( "empty dispatcher_handle" );
+
+      return m_disp->tiers_count();
+   }
+
+void
+dispatcher_handle_t::reset() noexcept
+   {
+      m_disp.reset();
+   }
+
+//
+// make_dispatcher
+//
+dispatcher_handle_t
+make_dispatcher(
+   so_5::environment_t & env,
+   const disp_params_t & params )
+   {
+      return impl::dispatcher_handle_maker_t::make(
+            std::make_shared< impl::dispatcher_t >( env, params ) );
+   }
+
+} /* namespace prio_tiers */
+
+} /* namespace custom_queue_disps */
@@ -0,0 +1,238 @@
+#pragma once
+
+#include <custom_queue_disps/one_thread.hpp>
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace custom_queue_disps
+{
+
+namespace prio_tiers
+{
+
+namespace impl
+{
+
+class dispatcher_t;
+
+using dispatcher_shptr_t = std::shared_ptr< dispatcher_t >;
+
+class dispatcher_handle_maker_t;
+
+} /* namespace impl */
+
+//
+// tier_params_t
+//
+/*!
+ * Parameters of one tier.
+ */
+class tier_params_t
+   {
+      std::size_t m_threads{ 1u };
+
+      one_thread::disp_params_t m_thread_params;
+
+   public:
+      tier_params_t() = default;
+
+      /*!
+       * Sets the count of worker threads for the tier.
+       *
+       * There is one thread by default.
+       */
+      tier_params_t &
+      threads( std::size_t count )
+         {
+            m_threads = count;
+            return *this;
+         }
+
+      [[nodiscard]]
+      std::size_t
+      threads() const noexcept { return m_threads; }
+
+      /*!
+       * Sets parameters for every worker thread of the tier.
+       *
+       * Every worker thread is an instance of one_thread dispatcher, so
+       * all its parameters (like thread_priority() or watchdog()) can
+       * be used.
+       */
+      tier_params_t &
+      thread_params( one_thread::disp_params_t params )
+         {
+            m_thread_params = std::move(params);
+            return *this;
+         }
+
+      [[nodiscard]]
+      const one_thread::disp_params_t &
+      thread_params() const noexcept { return m_thread_params; }
+   };
+
+//
+// disp_params_t
+//
+/*!
+ * Parameters for prio_tiers dispatcher.
+ *
+ * Tiers are numbered from 0 in the order of their definition.
+ *
+ * Usage example:
+ * @code
+ * namespace cqd = custom_queue_disps;
+ * auto disp = cqd::prio_tiers::make_dispatcher(env,
+ *    cqd::prio_tiers::disp_params_t{}
+ *       // Tier 0: latency-critical agents.
+ *       .tier(cqd::prio_tiers::tier_params_t{}
+ *          .thread_params(cqd::one_thread::disp_params_t{}
+ *             .thread_priority(10)))
+ *       // Tier 1: bulk work.
+ *       .tier(cqd::prio_tiers::tier_params_t{}.threads(2)));
+ * @endcode
+ */
+class disp_params_t
+   {
+      std::vector< tier_params_t > m_tiers;
+
+   public:
+      disp_params_t() = default;
+
+      //! Adds a new tier.
+      disp_params_t &
+      tier( tier_params_t params )
+         {
+            m_tiers.push_back( std::move(params) );
+            return *this;
+         }
+
+      [[nodiscard]]
+      const std::vector< tier_params_t > &
+      tiers() const noexcept { return m_tiers; }
+   };
+
+//
+// dispatcher_handle_t
+//
+
+/*!
+ * A handle for prio_tiers dispatcher.
+ *
+ * prio_tiers dispatcher is a set of tiers. Every tier has its own
+ * worker threads, so agents from different tiers don't share a worker
+ * thread. Every worker thread is an instance of one_thread dispatcher,
+ * so every binder still has its own demand_queue.
+ *
+ * Binders for a tier are distributed between worker threads of the tier
+ * in round-robin manner. All agents bound via the same binder work on
+ * the same worker thread.
+ *
+ * @note
+ * Binders created by binder() method hold references to their worker
+ * threads. So worker threads will be stopped only when dispatcher_handle
+ * and all binders are gone.
+ */
+class [[nodiscard]] dispatcher_handle_t
+   {
+      friend class impl::dispatcher_handle_maker_t;
+
+      impl::dispatcher_shptr_t m_disp;
+
+      dispatcher_handle_t( impl::dispatcher_shptr_t disp );
+
+   public :
+      dispatcher_handle_t() noexcept = default;
+
+      /*!
+       * Creates and returns a binder that will use @a demand_queue
+       * for agents bound via that binder. Agents will work on a worker
+       * thread of @a tier.
+       *
+       * Throws if @a tier isn't defined.
+       */
+      [[nodiscard]]
+      so_5::disp_binder_shptr_t
+      binder(
+         demand_queue_shptr_t demand_queue,
+         std::size_t tier ) const;
+
+      /*!
+       * Creates and returns a binder that will use @a demand_queue
+       * with additional parameters. Agents will work on a worker thread
+       * of @a tier.
+       *
+       * The scheduling group from @a params has to be defined in
+       * thread parameters of @a tier.
+       *
+       * Throws if @a tier isn't defined.
+       */
+      [[nodiscard]]
+      so_5::disp_binder_shptr_t
+      binder(
+         demand_queue_shptr_t demand_queue,
+         std::size_t tier,
+         const one_thread::binder_params_t & params ) const;
+
+      //! Returns the count of tiers.
+      [[nodiscard]]
+      std::size_t
+      tiers_count() const;
+
+      /*!
+       * Returns true if dispatcher_handler is not empty and holds
+       * a reference to the dispatcher.
+       */
+      [[nodiscard]]
+      operator bool() const noexcept { return static_cast< bool >( m_disp ); }
+
+      /*!
+       * Returns true if dispatcher_handler is empty and doesn't hold
+       * a reference to the dispatcher.
+       */
+      [[nodiscard]]
+      bool
+      operator!() const noexcept { return !m_disp; }
+
+      /*!
+       * If dispatcher_handler is not empty then removes a reference
+       * and make the dispatcher_handler empty.
+       *
+       * Does nothing is dispatcher_handler is already empty.
+       */
+      void
+      reset() noexcept;
+   };
+
+//
+// make_dispatcher
+//
+/*!
+ * Creates and returns a new instance of prio_tiers dispatcher.
+ *
+ * Throws if there is no tiers in @a params or some tier has
+ * no threads.
+ *
+ * Usage example:
+ * @code
+ * auto disp = custom_queue_disps::prio_tiers::make_dispatcher(env,
+ *    custom_queue_disps::prio_tiers::disp_params_t{}
+ *       .tier({})
+ *       .tier(custom_queue_disps::prio_tiers::tier_params_t{}.threads(4)));
+ * coop.make_agent_with_binder<critical_agent>(
+ *    disp.binder(std::make_shared<my_queue>(), 0), ...);
+ * coop.make_agent_with_binder<bulk_agent>(
+ *    disp.binder(std::make_shared<my_queue>(), 1), ...);
+ * @endcode
+ */
+[[nodiscard]]
+dispatcher_handle_t
+make_dispatcher(
+   so_5::environment_t & env,
+   const disp_params_t & params );
+
+} /* namespace prio_tiers */
+
+} /* namespace custom_queue_disps */
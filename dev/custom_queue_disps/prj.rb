@@ -10,6 +10,14 @@ MxxRu::Cpp::lib_target {
 
   required_prj 'so_5/prj_s.rb'
 
+  # USDT probes require <sys/sdt.h> from SystemTap.
+  if ENV[ 'CUSTOM_QUEUE_DISPS_USDT' ]
+    define 'CUSTOM_QUEUE_DISPS_USDT'
+  end
+
   cpp_source 'one_thread.cpp'
+  cpp_source 'prio_tiers.cpp'
+  cpp_source 'trace.cpp'
+  cpp_source 'watchdog.cpp'
 }
 
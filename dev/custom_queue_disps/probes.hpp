@@ -0,0 +1,72 @@
+#pragma once
+
+/*!
+ * Static probes (USDT) for the dispatcher's hot path.
+ *
+ * Probes are compiled only if CUSTOM_QUEUE_DISPS_USDT is defined
+ * (see CUSTOM_QUEUE_DISPS_USDT option in CMakeLists.txt). <sys/sdt.h>
+ * from SystemTap is required in that case. Otherwise probe macros are
+ * expanded to nothing and their arguments aren't evaluated.
+ *
+ * All probes belong to the `custom_queue_disps` provider. Arguments are:
+ *
+ * - demand_pushed(queue, receiver, msg_type)
+ *   a demand is stored into a queue by a thread other than the worker;
+ * - demand_staged(queue, receiver, msg_type)
+ *   a demand is pushed from the worker thread;
+ * - queue_activated(queue, receiver, msg_type)
+ *   an empty queue became non-empty;
+ * - worker_wakeup(queue, receiver, msg_type)
+ *   the sleeping worker is notified by a push;
+ * - worker_wait(deferred_queues)
+ *   the worker starts waiting on the condition variable;
+ * - worker_woken()
+ *   the worker returns from the wait;
+ * - demand_extracted(queue, receiver, msg_type)
+ *   try_extract() returns a demand;
+ * - extract_empty(queue)
+ *   try_extract() returns nothing for a non-empty queue;
+ * - handler_start(queue, receiver, msg_type)
+ * - handler_finish(queue, receiver, msg_type, duration_ns)
+ *   before and after the call of an event handler.
+ *
+ * `queue` is the address of demand_queue_t, `receiver` is the address
+ * of the agent and `msg_type` is the result of std::type_info::name().
+ *
+ * Usage example:
+ * @code
+ * bpftrace -e 'usdt:./demo_app:custom_queue_disps:handler_finish
+ *    { @[str(arg2)] = hist(arg3); }'
+ * @endcode
+ */
+
+#if defined(CUSTOM_QUEUE_DISPS_USDT)
+
+   #include <sys/sdt.h>
+
+   #define CQD_PROBE0(probe) \
+      DTRACE_PROBE(custom_queue_disps, probe)
+   #define CQD_PROBE1(probe, a1) \
+      DTRACE_PROBE1(custom_queue_disps, probe, a1)
+   #define CQD_PROBE3(probe, a1, a2, a3) \
+      DTRACE_PROBE3(custom_queue_disps, probe, a1, a2, a3)
+   #define CQD_PROBE4(probe, a1, a2, a3, a4) \
+      DTRACE_PROBE4(custom_queue_disps, probe, a1, a2, a3, a4)
+
+   //! A shorthand for probes with demand's description.
+   #define CQD_DEMAND_PROBE(probe, queue, demand) \
+      CQD_PROBE3(probe, \
+            static_cast< const void * >( queue ), \
+            static_cast< const void * >( (demand).m_receiver ), \
+            (demand).m_msg_type.name() )
+
+#else
+
+   #define CQD_PROBE0(probe) ((void)0)
+   #define CQD_PROBE1(probe, a1) ((void)0)
+   #define CQD_PROBE3(probe, a1, a2, a3) ((void)0)
+   #define CQD_PROBE4(probe, a1, a2, a3, a4) ((void)0)
+
+   #define CQD_DEMAND_PROBE(probe, queue, demand) ((void)0)
+
+#endif
@@ -0,0 +1,272 @@
+#include <custom_queue_disps/trace.hpp>
+
+#include <algorithm>
+#include <stdexcept>
+#include <string_view>
+
+namespace custom_queue_disps
+{
+
+namespace trace
+{
+
+namespace
+{
+
+constexpr char signature[] = { 'C', 'Q', 'D', 'T', 'R', 'A', 'C', 'E' };
+
+constexpr std::uint64_t current_version{ 2u };
+
+[[nodiscard]]
+demand_kind_t
+kind_of( const so_5::execution_demand_t & demand ) noexcept
+   {
+      if( so_5::agent_t::get_demand_handler_on_start_ptr()
+            == demand.m_demand_handler )
+         return demand_kind_t::start;
+
+      if( so_5::agent_t::get_demand_handler_on_finish_ptr()
+            == demand.m_demand_handler )
+         return demand_kind_t::finish;
+
+      return demand_kind_t::message;
+   }
+
+} /* namespace anonymous */
+
+//
+// recorder_t
+//
+
+recorder_t::recorder_t( const std::string & file_name )
+   :  m_to{ file_name, std::ios::binary | std::ios::trunc }
+   ,  m_started_at{ clock_t::now() }
+   {
+      if( !m_to )
+         throw std::runtime_error( "unable to open trace file: " + file_name );
+
+      m_to.write( signature, sizeof(signature) );
+      write_varint( current_version );
+   }
+
+recorder_t::~recorder_t()
+   {
+      m_to.flush();
+   }
+
+void
+recorder_t::demand_enqueued(
+   const demand_queue_t & queue,
+   const so_5::execution_demand_t & demand )
+   {
+      std::lock_guard< std::mutex > lock{ m_lock };
+
+      // NOTE: ID of message type has to be calculated before the start
+      // of the record because type_name record can be written.
+      const auto type_id = id_of( demand.m_msg_type );
+
+      write_header( event_t::enqueued );
+      write_varint( id_of( &queue ) );
+      write_varint( type_id );
+      write_varint( id_of( demand.m_receiver ) );
+      m_to.put( static_cast< char >( kind_of( demand ) ) );
+   }
+
+void
+recorder_t::demand_dequeued(
+   const demand_queue_t & queue,
+   const so_5::execution_demand_t & demand )
+   {
+      std::lock_guard< std::mutex > lock{ m_lock };
+
+      const auto type_id = id_of( demand.m_msg_type );
+
+      write_header( event_t::dequeued );
+      write_varint( id_of( &queue ) );
+      write_varint( type_id );
+      write_varint( id_of( demand.m_receiver ) );
+   }
+
+void
+recorder_t::demand_handled(
+   const so_5::execution_demand_t & demand,
+   std::chrono::steady_clock::duration duration )
+   {
+      std::lock_guard< std::mutex > lock{ m_lock };
+
+      const auto type_id = id_of( demand.m_msg_type );
+
+      write_header( event_t::handled );
+      write_varint( type_id );
+      write_varint( id_of( demand.m_receiver ) );
+      write_varint( static_cast< std::uint64_t >(
+            std::chrono::duration_cast< std::chrono::nanoseconds >(
+                  duration ).count() ) );
+   }
+
+std::uint64_t
+recorder_t::id_of( const void * ptr )
+   {
+      return m_ids.emplace( ptr, m_ids.size() ).first->second;
+   }
+
+std::uint32_t
+recorder_t::id_of( const std::type_index & type )
+   {
+      const auto [it, inserted] = m_type_ids.emplace(
+            type, static_cast< std::uint32_t >( m_type_ids.size() ) );
+      if( inserted )
+         {
+            // Name of the type has to be stored before the first usage.
+            const std::string_view name{ type.name() };
+
+            m_to.put( static_cast< char >( event_t::type_name ) );
+            write_varint( it->second );
+            write_varint( name.size() );
+            m_to.write( name.data(),
+                  static_cast< std::streamsize >( name.size() ) );
+         }
+
+      return it->second;
+   }
+
+void
+recorder_t::write_varint( std::uint64_t v )
+   {
+      do
+         {
+            char b = static_cast< char >( v & 0x7fu );
+            v >>= 7;
+            if( v )
+               b = static_cast< char >( b | 0x80 );
+            m_to.put( b );
+         }
+      while( v );
+   }
+
+void
+recorder_t::write_header( event_t event )
+   {
+      const auto now = static_cast< std::uint64_t >(
+            std::chrono::duration_cast< std::chrono::nanoseconds >(
+                  clock_t::now() - m_started_at ).count() );
+
+      m_to.put( static_cast< char >( event ) );
+      write_varint( now - m_last_timestamp );
+      m_last_timestamp = now;
+   }
+
+//
+// reader_t
+//
+
+reader_t::reader_t( const std::string & file_name )
+   :  m_from{ file_name, std::ios::binary }
+   {
+      if( !m_from )
+         throw std::runtime_error( "unable to open trace file: " + file_name );
+
+      char actual_signature[ sizeof(signature) ];
+      m_from.read( actual_signature, sizeof(actual_signature) );
+      if( !m_from || !std::equal(
+            std::begin(signature), std::end(signature), actual_signature ) )
+         throw std::runtime_error( "not a trace file: " + file_name );
+
+      if( current_version != read_varint() )
+         throw std::runtime_error(
+               "unsupported version of trace file: " + file_name );
+   }
+
+std::optional< record_t >
+reader_t::next()
+   {
+      for(;;)
+         {
+            const auto kind = m_from.get();
+            if( std::char_traits< char >::eof() == kind )
+               return std::nullopt;
+
+            const auto event = static_cast< event_t >( kind );
+            if( event_t::type_name == event )
+               {
+                  const auto id = read_varint();
+                  const auto len = read_varint();
+                  if( id != m_type_names.size() )
+                     throw std::runtime_error( "unexpected message type ID" );
+
+                  std::string name( len, '\0' );
+                  m_from.read( name.data(), static_cast< std::streamsize >(len) );
+                  if( !m_from )
+                     throw std::runtime_error( "unexpected end of trace" );
+
+                  m_type_names.push_back( std::move(name) );
+                  continue;
+               }
+
+            if( event_t::enqueued != event && event_t::dequeued != event
+                  && event_t::handled != event )
+               throw std::runtime_error( "unknown record in trace" );
+
+            record_t r{ event };
+            m_last_timestamp += read_varint();
+            r.m_timestamp = m_last_timestamp;
+            if( event_t::handled != event )
+               r.m_queue_id = read_varint();
+
+            r.m_msg_type_id = static_cast< std::uint32_t >( read_varint() );
+            if( r.m_msg_type_id >= m_type_names.size() )
+               throw std::runtime_error( "unknown message type ID" );
+
+            r.m_receiver_id = read_varint();
+            if( event_t::enqueued == event )
+               r.m_demand_kind = read_demand_kind();
+            else if( event_t::handled == event )
+               r.m_duration = read_varint();
+
+            return r;
+         }
+   }
+
+const std::string &
+reader_t::type_name( std::uint32_t msg_type_id ) const
+   {
+      return m_type_names.at( msg_type_id );
+   }
+
+demand_kind_t
+reader_t::read_demand_kind()
+   {
+      const auto b = m_from.get();
+      if( std::char_traits< char >::eof() == b )
+         throw std::runtime_error( "unexpected end of trace" );
+
+      const auto kind = static_cast< demand_kind_t >( b );
+      if( demand_kind_t::message != kind && demand_kind_t::start != kind
+            && demand_kind_t::finish != kind )
+         throw std::runtime_error( "unknown demand kind in trace" );
+
+      return kind;
+   }
+
+std::uint64_t
+reader_t::read_varint()
+   {
+      std::uint64_t result{};
+      for( unsigned shift = 0u; shift < 64u; shift += 7u )
+         {
+            const auto b = m_from.get();
+            if( std::char_traits< char >::eof() == b )
+               throw std::runtime_error( "unexpected end of trace" );
+
+            result |= static_cast< std::uint64_t >( b & 0x7f ) << shift;
+            if( !( b & 0x80 ) )
+               return result;
+         }
+
+      throw std::runtime_error( "malformed varint in trace" );
+   }
+
+} /* namespace trace */
+
+} /* namespace custom_queue_disps */
+
@@ -0,0 +1,252 @@
+#pragma once
+
+#include <custom_queue_disps/demand_queue.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <typeindex>
+#include <unordered_map>
+#include <vector>
+
+namespace custom_queue_disps
+{
+
+namespace trace
+{
+
+/*!
+ * Kind of an event stored in a trace.
+ */
+enum class event_t : std::uint8_t
+   {
+      //! Description of a new message type.
+      //! It isn't returned by reader_t::next().
+      type_name = 0,
+      //! A demand was pushed to a demand_queue.
+      enqueued = 1,
+      //! A demand was extracted from a demand_queue.
+      dequeued = 2,
+      //! The handler for a demand has completed.
+      handled = 3
+   };
+
+/*!
+ * Kind of a demand stored in event_t::enqueued records.
+ *
+ * Queue policies handle demands for evt_start and evt_finish
+ * differently from ordinary messages, so the kind is needed for
+ * the replay of a trace.
+ */
+enum class demand_kind_t : std::uint8_t
+   {
+      //! An ordinary message or signal.
+      message = 0,
+      //! The demand for evt_start.
+      start = 1,
+      //! The demand for evt_finish.
+      finish = 2
+   };
+
+//
+// record_t
+//
+/*!
+ * One event read from a trace.
+ *
+ * All times are in nanoseconds.
+ */
+struct record_t
+   {
+      event_t m_event;
+
+      //! Time since the start of recording.
+      std::uint64_t m_timestamp{};
+
+      //! ID of demand_queue.
+      /*!
+       * @note
+       * It's always 0 for event_t::handled.
+       */
+      std::uint64_t m_queue_id{};
+
+      //! ID of the receiver.
+      std::uint64_t m_receiver_id{};
+
+      //! ID of message type.
+      /*!
+       * The name of message type can be obtained by
+       * reader_t::type_name().
+       */
+      std::uint32_t m_msg_type_id{};
+
+      //! Kind of the demand.
+      /*!
+       * @note
+       * It's always demand_kind_t::message for event_t::dequeued and
+       * event_t::handled.
+       */
+      demand_kind_t m_demand_kind{ demand_kind_t::message };
+
+      //! The duration of the handler.
+      /*!
+       * @note
+       * It's always 0 for event_t::enqueued and event_t::dequeued.
+       */
+      std::uint64_t m_duration{};
+   };
+
+//
+// recorder_t
+//
+/*!
+ * Recorder of demand's events in a compact binary form.
+ *
+ * The file starts with the "CQDTRACE" signature followed by the version
+ * number. Then records follow. Every record starts with one byte that
+ * holds a value of event_t. All integers are stored as LEB128 varints.
+ * Records for event_t::enqueued end with one byte that holds a value
+ * of demand_kind_t.
+ * Timestamps are stored as deltas from the previous record.
+ * Receivers, queues and message types are replaced by small numeric IDs.
+ * A name of message type is stored just once, when that type is seen
+ * for the first time.
+ *
+ * Recorder is thread-safe and can be used by several dispatchers at
+ * the same time.
+ *
+ * Usage example:
+ * @code
+ * auto disp = custom_queue_disps::one_thread::make_dispatcher(env,
+ *    custom_queue_disps::one_thread::disp_params_t{}
+ *       .trace_recorder(
+ *          std::make_shared<custom_queue_disps::trace::recorder_t>(
+ *             "demands.cqdtrace")));
+ * @endcode
+ */
+class recorder_t
+   {
+      using clock_t = std::chrono::steady_clock;
+
+      std::mutex m_lock;
+
+      std::ofstream m_to;
+
+      const clock_t::time_point m_started_at;
+      std::uint64_t m_last_timestamp{};
+
+      std::unordered_map< const void *, std::uint64_t > m_ids;
+      std::unordered_map< std::type_index, std::uint32_t > m_type_ids;
+
+      [[nodiscard]]
+      std::uint64_t
+      id_of( const void * ptr );
+
+      [[nodiscard]]
+      std::uint32_t
+      id_of( const std::type_index & type );
+
+      void
+      write_varint( std::uint64_t v );
+
+      void
+      write_header( event_t event );
+
+   public:
+      /*!
+       * Opens @a file_name for writing.
+       *
+       * Throws if the file can't be opened.
+       */
+      recorder_t( const std::string & file_name );
+
+      recorder_t( const recorder_t & ) = delete;
+      recorder_t &
+      operator=( const recorder_t & ) = delete;
+
+      ~recorder_t();
+
+      void
+      demand_enqueued(
+         const demand_queue_t & queue,
+         const so_5::execution_demand_t & demand );
+
+      void
+      demand_dequeued(
+         const demand_queue_t & queue,
+         const so_5::execution_demand_t & demand );
+
+      void
+      demand_handled(
+         const so_5::execution_demand_t & demand,
+         std::chrono::steady_clock::duration duration );
+   };
+
+/*!
+ * A shorthand for shared_ptr to recorder.
+ */
+using recorder_shptr_t = std::shared_ptr< recorder_t >;
+
+//
+// reader_t
+//
+/*!
+ * Reader of a trace written by recorder_t.
+ *
+ * Throws std::runtime_error if a trace is malformed.
+ */
+class reader_t
+   {
+      std::ifstream m_from;
+
+      std::uint64_t m_last_timestamp{};
+
+      std::vector< std::string > m_type_names;
+
+      [[nodiscard]]
+      std::uint64_t
+      read_varint();
+
+      [[nodiscard]]
+      demand_kind_t
+      read_demand_kind();
+
+   public:
+      /*!
+       * Opens @a file_name and checks the signature of a trace.
+       */
+      reader_t( const std::string & file_name );
+
+      /*!
+       * Returns the next record or empty optional at the end of the trace.
+       */
+      [[nodiscard]]
+      std::optional< record_t >
+      next();
+
+      /*!
+       * Returns the name of a message type.
+       *
+       * @note
+       * The name is the value of std::type_info::name() and can be
+       * mangled.
+       */
+      [[nodiscard]]
+      const std::string &
+      type_name( std::uint32_t msg_type_id ) const;
+
+      /*!
+       * Count of message types seen so far.
+       */
+      [[nodiscard]]
+      std::size_t
+      type_count() const noexcept { return m_type_names.size(); }
+   };
+
+} /* namespace trace */
+
+} /* namespace custom_queue_disps */
+
@@ -0,0 +1,250 @@
+#include <custom_queue_disps/watchdog.hpp>
+
+#include <algorithm>
+#include <sstream>
+
+namespace custom_queue_disps
+{
+
+namespace watchdog
+{
+
+namespace
+{
+
+[[nodiscard]]
+long_demand_handler_t
+make_default_handler( so_5::environment_t & env )
+   {
+      return [&env]( const long_demand_info_t & info ) {
+            std::ostringstream s;
+            s << "custom_queue_disps::watchdog: "
+                  << ( info.m_completed ?
+                        "long demand completed" : "long demand running" )
+                  << ", receiver: " << info.m_receiver
+                  << ", msg_type: " << info.m_msg_type.name()
+                  << ", duration: "
+                  << std::chrono::duration_cast< std::chrono::microseconds >(
+                        info.m_duration ).count()
+                  << "us";
+
+            env.error_logger().log( __FILE__, __LINE__, s.str() );
+         };
+   }
+
+} /* namespace anonymous */
+
+//
+// watchdog_t::slot_t
+//
+
+void
+watchdog_t::slot_t::demand_started(
+   const so_5::execution_demand_t & demand ) noexcept
+   {
+      std::lock_guard< std::mutex > lock{ m_lock };
+
+      m_busy = true;
+      m_reported = false;
+      m_final_demand = so_5::agent_t::get_demand_handler_on_finish_ptr()
+            == demand.m_demand_handler;
+      m_receiver = demand.m_receiver;
+      m_msg_type = demand.m_msg_type;
+      m_started_at = clock_t::now();
+   }
+
+void
+watchdog_t::slot_t::demand_finished() noexcept
+   {
+      long_demand_info_t info{ nullptr, typeid(void), {}, true };
+      bool reported;
+      bool final_demand;
+      {
+         std::lock_guard< std::mutex > lock{ m_lock };
+
+         m_busy = false;
+         info.m_duration = clock_t::now() - m_started_at;
+         final_demand = m_final_demand;
+         if( info.m_duration < m_owner.m_threshold && !final_demand )
+            return;
+
+         info.m_receiver = m_receiver;
+         info.m_msg_type = m_msg_type;
+         reported = m_reported;
+      }
+
+      // NOTE: the watchdog's lock is acquired after the release of
+      // the slot's lock. The watchdog's thread acquires them in
+      // the opposite order.
+      if( info.m_duration >= m_owner.m_threshold )
+         m_owner.demand_completed( info, reported );
+
+      if( final_demand )
+         m_owner.receiver_finished( info.m_receiver );
+   }
+
+//
+// watchdog_t
+//
+
+watchdog_t::watchdog_t(
+   so_5::environment_t & env,
+   clock_t::duration threshold,
+   long_demand_handler_t handler )
+   :  m_threshold{ threshold }
+   ,  m_handler{ handler ? std::move(handler) : make_default_handler( env ) }
+   {
+      m_thread = std::thread{ [this]{ thread_body(); } };
+   }
+
+watchdog_t::~watchdog_t()
+   {
+      {
+         std::lock_guard< std::mutex > lock{ m_lock };
+         m_shutdown = true;
+         m_wakeup_cv.notify_one();
+      }
+      m_thread.join();
+   }
+
+watchdog_t::slot_t &
+watchdog_t::acquire_slot()
+   {
+      std::lock_guard< std::mutex > lock{ m_lock };
+      return m_slots.emplace_back( *this );
+   }
+
+void
+watchdog_t::release_slot( slot_t & slot ) noexcept
+   {
+      std::lock_guard< std::mutex > lock{ m_lock };
+      m_slots.remove_if( [&slot]( const slot_t & s ) { return &s == &slot; } );
+   }
+
+std::vector< offender_t >
+watchdog_t::top_offenders( std::size_t count ) const
+   {
+      std::vector< offender_t > result;
+      {
+         std::lock_guard< std::mutex > lock{ m_lock };
+         for( const auto & receiver_kv : m_offenders )
+            for( const auto & kv : receiver_kv.second )
+               result.push_back( kv.second );
+      }
+
+      std::sort( result.begin(), result.end(),
+            []( const offender_t & a, const offender_t & b ) {
+               return a.m_count > b.m_count;
+            } );
+      if( result.size() > count )
+         result.erase( result.begin() + static_cast< std::ptrdiff_t >(count),
+               result.end() );
+
+      return result;
+   }
+
+void
+watchdog_t::thread_body() noexcept
+   {
+      // Check slots several times during the threshold to not miss
+      // the moment too much.
+      const auto check_period = std::max(
+            std::chrono::duration_cast< clock_t::duration >(
+                  std::chrono::microseconds{ 100 } ),
+            m_threshold / 4 );
+
+      std::vector< long_demand_info_t > reports;
+
+      std::unique_lock< std::mutex > lock{ m_lock };
+      while( !m_shutdown )
+         {
+            m_wakeup_cv.wait_for( lock, check_period );
+
+            reports.swap( m_pending_reports );
+
+            const auto now = clock_t::now();
+            for( auto & slot : m_slots )
+               {
+                  std::lock_guard< std::mutex > slot_lock{ slot.m_lock };
+                  if( slot.m_busy && !slot.m_reported &&
+                        now - slot.m_started_at >= m_threshold )
+                     {
+                        slot.m_reported = true;
+                        reports.push_back( long_demand_info_t{
+                              slot.m_receiver,
+                              slot.m_msg_type,
+                              now - slot.m_started_at,
+                              false
+                           } );
+                        update_offender( reports.back(), true );
+                     }
+               }
+
+            if( reports.empty() )
+               continue;
+
+            // The handler is called without the lock to allow workers
+            // to continue.
+            lock.unlock();
+            for( const auto & info : reports )
+               {
+                  try
+                     {
+                        m_handler( info );
+                     }
+                  catch( ... ) {}
+               }
+            reports.clear();
+            lock.lock();
+         }
+   }
+
+void
+watchdog_t::update_offender(
+   const long_demand_info_t & info,
+   bool new_occurrence )
+   {
+      auto & offenders = m_offenders[ info.m_receiver ];
+      auto it = offenders.find( info.m_msg_type );
+      if( it == offenders.end() )
+         it = offenders.emplace( info.m_msg_type,
+               offender_t{ info.m_receiver, info.m_msg_type, 0u, {} } ).first;
+
+      if( new_occurrence )
+         ++(it->second.m_count);
+      it->second.m_max_duration = std::max(
+            it->second.m_max_duration, info.m_duration );
+   }
+
+void
+watchdog_t::demand_completed(
+   const long_demand_info_t & info,
+   bool reported ) noexcept
+   {
+      try
+         {
+            std::lock_guard< std::mutex > lock{ m_lock };
+
+            // If the demand was already reported then only its duration
+            // has to be updated.
+            update_offender( info, !reported );
+            if( !reported )
+               m_pending_reports.push_back( info );
+         }
+      catch( ... )
+         {
+            // There is nothing to do if the statistics can't be updated.
+         }
+   }
+
+void
+watchdog_t::receiver_finished( const so_5::agent_t * receiver ) noexcept
+   {
+      std::lock_guard< std::mutex > lock{ m_lock };
+      m_offenders.erase( receiver );
+   }
+
+} /* namespace watchdog */
+
+} /* namespace custom_queue_disps */
+
@@ -0,0 +1,241 @@
+#pragma once
+
+#include <so_5/all.hpp>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <typeindex>
+#include <vector>
+
+namespace custom_queue_disps
+{
+
+namespace watchdog
+{
+
+//
+// long_demand_info_t
+//
+/*!
+ * Description of a demand that runs longer than the threshold.
+ */
+struct long_demand_info_t
+   {
+      //! The receiver of the demand.
+      /*!
+       * @attention
+       * It's intended for identification only. The agent can be
+       * already destroyed when the info is handled.
+       */
+      const so_5::agent_t * m_receiver;
+
+      //! Type of the message.
+      std::type_index m_msg_type;
+
+      //! How long the handler runs (or has been running).
+      std::chrono::steady_clock::duration m_duration;
+
+      //! Is the handler already completed?
+      bool m_completed;
+   };
+
+/*!
+ * Type of callback for long demands.
+ *
+ * The callback is called on the watchdog's thread.
+ */
+using long_demand_handler_t =
+      std::function< void( const long_demand_info_t & ) >;
+
+//
+// offender_t
+//
+/*!
+ * Statistics for a pair of receiver and message type.
+ *
+ * Statistics for a receiver are dropped when its evt_finish is handled,
+ * so they don't grow with creation and destruction of agents and
+ * an address of a new agent doesn't inherit counters of the old one.
+ */
+struct offender_t
+   {
+      const so_5::agent_t * m_receiver;
+      std::type_index m_msg_type;
+
+      //! How many times the handler exceeded the threshold.
+      std::uint64_t m_count;
+
+      //! The longest observed duration of the handler.
+      std::chrono::steady_clock::duration m_max_duration;
+   };
+
+//
+// watchdog_t
+//
+/*!
+ * Watchdog for demands that are executed too long.
+ *
+ * Every worker thread tracks the demand that is currently executed
+ * in its own slot. The watchdog has a separate thread that checks
+ * slots periodically and reports demands that run longer than
+ * the threshold. Demands that exceeded the threshold but completed
+ * between checks are reported too.
+ *
+ * The same watchdog can be used by several dispatchers.
+ *
+ * Usage example:
+ * @code
+ * auto wd = std::make_shared<custom_queue_disps::watchdog::watchdog_t>(
+ *    env,
+ *    std::chrono::milliseconds{50},
+ *    [](const custom_queue_disps::watchdog::long_demand_info_t & info) {
+ *       std::cerr << "long handler for " << info.m_msg_type.name() << std::endl;
+ *    });
+ * auto disp = custom_queue_disps::one_thread::make_dispatcher(env,
+ *    custom_queue_disps::one_thread::disp_params_t{}.watchdog(wd));
+ * ...
+ * for(const auto & o : wd->top_offenders(10))
+ *    ...
+ * @endcode
+ */
+class watchdog_t
+   {
+   public:
+      using clock_t = std::chrono::steady_clock;
+
+      //
+      // slot_t
+      //
+      /*!
+       * Information about the demand executed by one worker thread.
+       */
+      class slot_t
+         {
+            friend class watchdog_t;
+
+            watchdog_t & m_owner;
+
+            std::mutex m_lock;
+
+            bool m_busy{ false };
+            bool m_reported{ false };
+            //! Is the current demand for evt_finish?
+            bool m_final_demand{ false };
+            const so_5::agent_t * m_receiver{ nullptr };
+            std::type_index m_msg_type{ typeid(void) };
+            clock_t::time_point m_started_at;
+
+         public:
+            slot_t( watchdog_t & owner ) noexcept
+               :  m_owner{ owner }
+               {}
+
+            //! Should be called by the worker before calling the handler.
+            void
+            demand_started( const so_5::execution_demand_t & demand ) noexcept;
+
+            //! Should be called by the worker after calling the handler.
+            void
+            demand_finished() noexcept;
+         };
+
+   private:
+      const clock_t::duration m_threshold;
+      const long_demand_handler_t m_handler;
+
+      mutable std::mutex m_lock;
+      std::condition_variable m_wakeup_cv;
+      bool m_shutdown{ false };
+
+      //! Slots of all workers.
+      /*!
+       * std::list is used because pointers to items have to be stable.
+       */
+      std::list< slot_t > m_slots;
+
+      //! Reports for demands completed between checks.
+      std::vector< long_demand_info_t > m_pending_reports;
+
+      //! Offenders grouped by receivers.
+      std::map<
+            const so_5::agent_t *,
+            std::map< std::type_index, offender_t > > m_offenders;
+
+      std::thread m_thread;
+
+      void
+      thread_body() noexcept;
+
+      //! Updates statistics for an offender.
+      /*!
+       * @attention
+       * Must be called with m_lock acquired.
+       */
+      void
+      update_offender( const long_demand_info_t & info, bool new_occurrence );
+
+      void
+      demand_completed( const long_demand_info_t & info, bool reported ) noexcept;
+
+      //! Drops statistics for a receiver that won't get demands anymore.
+      void
+      receiver_finished( const so_5::agent_t * receiver ) noexcept;
+
+   public:
+      /*!
+       * Starts the watchdog.
+       *
+       * If @a handler is empty the information about long demands
+       * is written to the error_logger of @a env.
+       *
+       * @attention
+       * The watchdog has to be destroyed before @a env.
+       */
+      watchdog_t(
+         so_5::environment_t & env,
+         clock_t::duration threshold,
+         long_demand_handler_t handler = long_demand_handler_t{} );
+
+      watchdog_t( const watchdog_t & ) = delete;
+      watchdog_t &
+      operator=( const watchdog_t & ) = delete;
+
+      ~watchdog_t();
+
+      [[nodiscard]]
+      clock_t::duration
+      threshold() const noexcept { return m_threshold; }
+
+      //! Allocates a slot for a new worker thread.
+      [[nodiscard]]
+      slot_t &
+      acquire_slot();
+
+      //! Returns a slot that is no more used by a worker thread.
+      void
+      release_slot( slot_t & slot ) noexcept;
+
+      /*!
+       * Returns up to @a count offenders with the biggest number of
+       * long executions.
+       */
+      [[nodiscard]]
+      std::vector< offender_t >
+      top_offenders( std::size_t count ) const;
+   };
+
+/*!
+ * A shorthand for shared_ptr to watchdog.
+ */
+using watchdog_shptr_t = std::shared_ptr< watchdog_t >;
+
+} /* namespace watchdog */
+
+} /* namespace custom_queue_disps */
+
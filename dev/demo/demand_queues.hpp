@@ -0,0 +1,830 @@
+#pragma once
+
+#include <custom_queue_disps/demand_queue.hpp>
+
+#include <so_5/all.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <limits>
+#include <list>
+#include <map>
+#include <memory_resource>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+namespace demo
+{
+
+//
+// Signals used by demo agents.
+//
+// They are defined here because hardcoded_priorities_t has to know them.
+//
+struct hello final : public so_5::signal_t {};
+struct bye final : public so_5::signal_t {};
+struct complete final : public so_5::signal_t {};
+
+//
+// Memory for pending demands.
+//
+// simple_fifo_t, hardcoded_priorities_t and dynamic_per_agent_priorities_t
+// take memory for pending demands from an upstream resource that can be
+// specified in the queue's constructor, so several queues can share
+// an arena (for example, one arena per dispatcher). Such an upstream has
+// to be thread safe if queues that share it can be used by different
+// threads at the same time.
+//
+// simple_fifo_t takes blocks of its deque from a pool owned by the queue.
+// The dispatcher serializes access to the queue, so the pool isn't
+// synchronized. Only blocks up to max_pooled_block go through the pool,
+// bigger ones (like the map of the deque) are taken from the upstream
+// directly. The pool doesn't return blocks to the upstream until
+// the queue is destroyed: after a burst the queue keeps the memory
+// taken for the biggest burst it has seen and reuses it.
+//
+// Priority queues hold pending demands in a vector that is taken from
+// the upstream directly. The storage for the expected burst is reserved
+// at the start, so a burst up to that size doesn't cause reallocation.
+// Memory taken for a larger burst is returned to the upstream when
+// the queue becomes empty.
+//
+constexpr std::size_t default_expected_burst{ 1024u };
+
+//! The largest block that is taken from the pool of simple_fifo_t.
+//! It's the size of a deque's block in libstdc++ and libc++.
+constexpr std::size_t max_pooled_block{ 512u };
+
+[[nodiscard]]
+inline std::pmr::pool_options
+make_pool_options(
+   std::size_t expected_burst,
+   std::size_t item_size ) noexcept
+   {
+      std::pmr::pool_options opts;
+      opts.max_blocks_per_chunk = std::max< std::size_t >(
+            1u, expected_burst * item_size / max_pooled_block );
+      opts.largest_required_pool_block = max_pooled_block;
+      return opts;
+   }
+
+//
+// Heap of pending demands for priority-based queues.
+//
+// std::priority_queue isn't used because it doesn't allow to reserve
+// the storage and to release it after a burst.
+//
+template< typename Item >
+class demand_heap_t
+   {
+      const std::size_t m_expected_burst;
+
+      std::pmr::vector< Item > m_items;
+
+   public:
+      demand_heap_t(
+         std::size_t expected_burst,
+         std::pmr::memory_resource * upstream )
+         :  m_expected_burst{ expected_burst }
+         ,  m_items{ upstream }
+         {
+            m_items.reserve( m_expected_burst );
+         }
+
+      [[nodiscard]]
+      bool
+      empty() const noexcept { return m_items.empty(); }
+
+      [[nodiscard]]
+      std::size_t
+      size() const noexcept { return m_items.size(); }
+
+      template< typename... Args >
+      void
+      emplace( Args && ...args )
+         {
+            m_items.emplace_back( std::forward<Args>(args)... );
+            std::push_heap( m_items.begin(), m_items.end() );
+         }
+
+      // NOTE: the heap must not be empty.
+      [[nodiscard]]
+      Item
+      pop() noexcept
+         {
+            std::pop_heap( m_items.begin(), m_items.end() );
+            Item result{ std::move(m_items.back()) };
+            m_items.pop_back();
+
+            if( m_items.empty() && m_items.capacity() > m_expected_burst )
+               release_burst_memory();
+
+            return result;
+         }
+
+   private:
+      void
+      release_burst_memory() noexcept
+         {
+            std::pmr::vector< Item >{ m_items.get_allocator() }.swap( m_items );
+
+            try
+               {
+                  m_items.reserve( m_expected_burst );
+               }
+            catch( ... )
+               {
+                  // It's not a problem, the storage will be
+                  // allocated by the next push.
+               }
+         }
+   };
+
+//
+// simple_fifo_t
+//
+class simple_fifo_t final : public custom_queue_disps::demand_queue_t
+   {
+      // NOTE: it has to be declared before m_queue.
+      std::pmr::unsynchronized_pool_resource m_memory;
+
+      std::pmr::deque< so_5::execution_demand_t > m_queue{ &m_memory };
+
+   public:
+      explicit simple_fifo_t(
+         std::size_t expected_burst = default_expected_burst,
+         std::pmr::memory_resource * upstream =
+               std::pmr::get_default_resource() )
+         :  m_memory{
+               make_pool_options(
+                     expected_burst, sizeof(so_5::execution_demand_t) ),
+               upstream }
+         {}
+
+      [[nodiscard]]
+      bool
+      empty() const noexcept override { return m_queue.empty(); }
+
+      [[nodiscard]]
+      std::size_t
+      size() const noexcept override { return m_queue.size(); }
+
+      [[nodiscard]]
+      std::optional<so_5::execution_demand_t>
+      try_extract() noexcept override
+         {
+            std::optional<so_5::execution_demand_t> result{
+               std::move(m_queue.front())
+            };
+            m_queue.pop_front();
+
+            return result;
+         }
+
+      void
+      push( so_5::execution_demand_t demand ) override
+         {
+            m_queue.push_back( std::move(demand) );
+         }
+   };
+
+//
+// hardcoded_priorities_t
+//
+class hardcoded_priorities_t final : public custom_queue_disps::demand_queue_t
+   {
+      using priority_t = std::uint_fast8_t;
+
+      static constexpr priority_t lowest{ 0u };
+      static constexpr priority_t low{ 1u };
+      static constexpr priority_t normal{ 2u };
+      static constexpr priority_t high{ 3u };
+      static constexpr priority_t highest{ 4u };
+
+      [[nodiscard]]
+      static priority_t
+      detect_priority( const so_5::execution_demand_t & d ) noexcept
+         {
+            if( so_5::agent_t::get_demand_handler_on_start_ptr()
+                  == d.m_demand_handler )
+               return highest;
+
+            if( so_5::agent_t::get_demand_handler_on_finish_ptr()
+                  == d.m_demand_handler )
+               return lowest;
+
+            if( std::type_index{ typeid(bye) } == d.m_msg_type )
+               return high;
+
+            if( std::type_index{ typeid(hello) } == d.m_msg_type )
+               return low;
+
+            return normal;
+         }
+
+      struct actual_demand_t
+         {
+            so_5::execution_demand_t m_demand;
+            priority_t m_priority;
+
+            actual_demand_t(
+               so_5::execution_demand_t demand,
+               priority_t priority )
+               :  m_demand{ std::move(demand) }
+               ,  m_priority{ priority }
+               {}
+
+            [[nodiscard]]
+            bool
+            operator<( const actual_demand_t & o ) const noexcept
+               {
+                  return m_priority < o.m_priority;
+               }
+         };
+
+      demand_heap_t< actual_demand_t > m_queue;
+
+   public:
+      explicit hardcoded_priorities_t(
+         std::size_t expected_burst = default_expected_burst,
+         std::pmr::memory_resource * upstream =
+               std::pmr::get_default_resource() )
+         :  m_queue{ expected_burst, upstream }
+         {}
+
+      [[nodiscard]]
+      bool
+      empty() const noexcept override { return m_queue.empty(); }
+
+      [[nodiscard]]
+      std::size_t
+      size() const noexcept override { return m_queue.size(); }
+
+      [[nodiscard]]
+      std::optional<so_5::execution_demand_t>
+      try_extract() noexcept override
+         {
+            return { m_queue.pop().m_demand };
+         }
+
+      void
+      push( so_5::execution_demand_t demand ) override
+         {
+            const auto prio = detect_priority( demand );
+            m_queue.emplace( std::move(demand), prio );
+         }
+   };
+
+//
+// dynamic_per_agent_priorities_t
+//
+
+class dynamic_per_agent_priorities_t final
+   : public custom_queue_disps::demand_queue_t
+   {
+   public:
+      using priority_t = std::uint_fast8_t;
+
+      static constexpr priority_t lowest{ 0u };
+      static constexpr priority_t low{ 1u };
+      static constexpr priority_t normal{ 2u };
+      static constexpr priority_t high{ 3u };
+      static constexpr priority_t highest{ 4u };
+
+   private:
+      // Type of map from message to a priority.
+      using type_to_prio_map_t = std::map< std::type_index, priority_t >;
+
+      // Type of map from agent's pointer to a map of message priorities.
+      using agent_to_prio_map_t =
+            std::map< so_5::agent_t *, type_to_prio_map_t >;
+
+      // Type of demand to be stored in the priority queue.
+      struct actual_demand_t
+         {
+            so_5::execution_demand_t m_demand;
+            priority_t m_priority;
+
+            actual_demand_t(
+               so_5::execution_demand_t demand,
+               priority_t priority )
+               :  m_demand{ std::move(demand) }
+               ,  m_priority{ priority }
+               {}
+
+            [[nodiscard]]
+            bool
+            operator<( const actual_demand_t & o ) const noexcept
+               {
+                  return m_priority < o.m_priority;
+               }
+         };
+
+      // The lock for priorities map.
+      std::mutex m_prio_map_lock;
+      // Container of agent's priorities.
+      agent_to_prio_map_t m_agent_prios;
+
+      // Queue of pending priorities.
+      demand_heap_t< actual_demand_t > m_queue;
+
+      // Not only detects a priority but also removes priorities
+      // for an agent if `d` is the final demand for that agent.
+      [[nodiscard]]
+      priority_t
+      handle_new_demand_priority( const so_5::execution_demand_t & d ) noexcept
+         {
+            if( so_5::agent_t::get_demand_handler_on_start_ptr()
+                  == d.m_demand_handler )
+               return highest;
+
+            if( so_5::agent_t::get_demand_handler_on_finish_ptr()
+                  == d.m_demand_handler )
+               {
+                  // There is no more need for priorities for that agent.
+                  std::lock_guard< std::mutex > lock{ m_prio_map_lock };
+                  m_agent_prios.erase( d.m_receiver );
+                  return lowest;
+               }
+
+            {
+               // We have to search priority for the message for that agent.
+               std::lock_guard< std::mutex > lock{ m_prio_map_lock };
+               auto it_agent = m_agent_prios.find( d.m_receiver );
+               if( it_agent != m_agent_prios.end() )
+                  {
+                     auto it_msg = it_agent->second.find( d.m_msg_type );
+                     if( it_msg != it_agent->second.end() )
+                        return it_msg->second;
+                  }
+            }
+
+            return normal;
+         }
+
+   public:
+      explicit dynamic_per_agent_priorities_t(
+         std::size_t expected_burst = default_expected_burst,
+         std::pmr::memory_resource * upstream =
+               std::pmr::get_default_resource() )
+         :  m_queue{ expected_burst, upstream }
+         {}
+
+      void
+      define_priority(
+         so_5::agent_t * receiver,
+         std::type_index msg_type,
+         priority_t priority )
+         {
+            std::lock_guard< std::mutex > lock{ m_prio_map_lock };
+
+            m_agent_prios[ receiver ][ msg_type ] = priority;
+         }
+
+      [[nodiscard]]
+      bool
+      empty() const noexcept override { return m_queue.empty(); }
+
+      [[nodiscard]]
+      std::size_t
+      size() const noexcept override { return m_queue.size(); }
+
+      [[nodiscard]]
+      std::optional<so_5::execution_demand_t>
+      try_extract() noexcept override
+         {
+            return { m_queue.pop().m_demand };
+         }
+
+      void
+      push( so_5::execution_demand_t demand ) override
+         {
+            const auto prio = handle_new_demand_priority( demand );
+            m_queue.emplace( std::move(demand), prio );
+         }
+   };
+
+//
+// rate_limited_t
+//
+/*!
+ * A queue that limits the rate of demands for some message types
+ * and/or some receivers by token buckets.
+ *
+ * Limits have to be defined by limit_message_type() and limit_receiver()
+ * before the queue is passed to the dispatcher.
+ *
+ * Demands are stored in lanes. There is a lane for every combination
+ * of buckets (demands without limits go to a separate lane). Demands
+ * within a lane are handled in FIFO order. A ready demand with
+ * the smallest sequence number is extracted from all lanes, so a demand
+ * that waits for tokens doesn't block demands from other lanes. It means
+ * that demands from different lanes can be reordered.
+ *
+ * Demands for evt_start and evt_finish aren't limited. But evt_finish
+ * is extracted only when all previously pushed demands are extracted.
+ *
+ * If there is no ready demands, ready_at() tells the dispatcher when
+ * the next token will be available, so the dispatcher doesn't spin.
+ */
+class rate_limited_t final : public custom_queue_disps::demand_queue_t
+   {
+   public:
+      using clock_t = std::chrono::steady_clock;
+
+   private:
+      struct bucket_t
+         {
+            // Tokens per second.
+            double m_rate;
+            double m_capacity;
+            double m_tokens;
+            clock_t::time_point m_updated_at;
+
+            bucket_t( double rate, double burst )
+               :  m_rate{ rate }
+               ,  m_capacity{ burst }
+               ,  m_tokens{ burst }
+               ,  m_updated_at{ clock_t::now() }
+               {
+                  // NOTE: negated comparisons reject NaN too.
+                  if( !(rate > 0.0) )
+                     throw std::runtime_error(
+                           "rate of rate_limited_t has to be positive" );
+                  if( !(burst >= 1.0) )
+                     throw std::runtime_error(
+                           "burst of rate_limited_t can't be less than 1" );
+               }
+
+            void
+            refill( clock_t::time_point now ) noexcept
+               {
+                  if( now <= m_updated_at )
+                     return;
+
+                  const std::chrono::duration< double > passed =
+                        now - m_updated_at;
+                  m_tokens = std::min( m_capacity,
+                        m_tokens + passed.count() * m_rate );
+                  m_updated_at = now;
+               }
+
+            // Time point when at least one token will be available.
+            [[nodiscard]]
+            clock_t::time_point
+            ready_at() const noexcept
+               {
+                  if( m_tokens >= 1.0 )
+                     return m_updated_at;
+
+                  return m_updated_at +
+                        std::chrono::duration_cast< clock_t::duration >(
+                              std::chrono::duration< double >{
+                                    (1.0 - m_tokens) / m_rate } );
+               }
+         };
+
+      // Pair of buckets for a demand. Any of them can be nullptr.
+      using lane_key_t = std::pair< bucket_t *, bucket_t * >;
+
+      struct lane_item_t
+         {
+            std::uint64_t m_seq;
+            so_5::execution_demand_t m_demand;
+         };
+
+      using lane_t = std::deque< lane_item_t >;
+
+      std::map< std::type_index, bucket_t > m_type_buckets;
+      std::map< const so_5::agent_t *, bucket_t > m_receiver_buckets;
+
+      // Only non-empty lanes are stored.
+      std::map< lane_key_t, lane_t > m_lanes;
+
+      std::uint64_t m_next_seq{};
+
+      std::size_t m_size{};
+
+      [[nodiscard]]
+      static bool
+      is_start( const so_5::execution_demand_t & d ) noexcept
+         {
+            return so_5::agent_t::get_demand_handler_on_start_ptr()
+                  == d.m_demand_handler;
+         }
+
+      [[nodiscard]]
+      static bool
+      is_finish( const so_5::execution_demand_t & d ) noexcept
+         {
+            return so_5::agent_t::get_demand_handler_on_finish_ptr()
+                  == d.m_demand_handler;
+         }
+
+      [[nodiscard]]
+      lane_key_t
+      detect_lane( const so_5::execution_demand_t & d ) noexcept
+         {
+            if( is_start( d ) || is_finish( d ) )
+               return { nullptr, nullptr };
+
+            lane_key_t key{ nullptr, nullptr };
+
+            auto it_type = m_type_buckets.find( d.m_msg_type );
+            if( it_type != m_type_buckets.end() )
+               key.first = &(it_type->second);
+
+            auto it_receiver = m_receiver_buckets.find( d.m_receiver );
+            if( it_receiver != m_receiver_buckets.end() )
+               key.second = &(it_receiver->second);
+
+            return key;
+         }
+
+      // The smallest sequence number of all pending demands.
+      [[nodiscard]]
+      std::uint64_t
+      min_seq() const noexcept
+         {
+            std::uint64_t result{ std::numeric_limits< std::uint64_t >::max() };
+            for( const auto & kv : m_lanes )
+               result = std::min( result, kv.second.front().m_seq );
+
+            return result;
+         }
+
+      // Time point when the head of the lane can be extracted.
+      [[nodiscard]]
+      static clock_t::time_point
+      lane_ready_at( const lane_key_t & key ) noexcept
+         {
+            clock_t::time_point result{};
+            if( key.first )
+               result = std::max( result, key.first->ready_at() );
+            if( key.second )
+               result = std::max( result, key.second->ready_at() );
+
+            return result;
+         }
+
+      // Extracts the head of the lane.
+      [[nodiscard]]
+      std::optional<so_5::execution_demand_t>
+      take_head( std::map< lane_key_t, lane_t >::iterator lane ) noexcept
+         {
+            std::optional<so_5::execution_demand_t> result{
+               std::move(lane->second.front().m_demand)
+            };
+            lane->second.pop_front();
+            --m_size;
+            if( lane->second.empty() )
+               m_lanes.erase( lane );
+
+            if( is_finish( *result ) )
+               // There won't be demands for that agent anymore.
+               m_receiver_buckets.erase( result->m_receiver );
+
+            return result;
+         }
+
+   public:
+      rate_limited_t() = default;
+
+      /*!
+       * Limits the rate of messages of type @a msg_type.
+       *
+       * @a rate is in messages per second, @a burst is the maximum count
+       * of messages that can be handled without a delay.
+       *
+       * Throws if @a rate isn't positive or @a burst is less than 1.
+       */
+      void
+      limit_message_type(
+         std::type_index msg_type,
+         double rate,
+         double burst )
+         {
+            m_type_buckets.insert_or_assign( msg_type, bucket_t{ rate, burst } );
+         }
+
+      /*!
+       * Limits the rate of all messages for @a receiver.
+       *
+       * @a rate is in messages per second, @a burst is the maximum count
+       * of messages that can be handled without a delay.
+       *
+       * Throws if @a rate isn't positive or @a burst is less than 1.
+       */
+      void
+      limit_receiver(
+         const so_5::agent_t * receiver,
+         double rate,
+         double burst )
+         {
+            m_receiver_buckets.insert_or_assign( receiver, bucket_t{ rate, burst } );
+         }
+
+      [[nodiscard]]
+      bool
+      empty() const noexcept override { return m_lanes.empty(); }
+
+      [[nodiscard]]
+      std::size_t
+      size() const noexcept override { return m_size; }
+
+      [[nodiscard]]
+      std::optional<so_5::execution_demand_t>
+      try_extract() noexcept override
+         {
+            const auto now = clock_t::now();
+            const auto first_seq = min_seq();
+
+            auto selected = m_lanes.end();
+            for( auto it = m_lanes.begin(); it != m_lanes.end(); ++it )
+               {
+                  const auto & head = it->second.front();
+                  if( selected != m_lanes.end() &&
+                        selected->second.front().m_seq < head.m_seq )
+                     continue;
+
+                  // evt_finish has to wait for all previous demands.
+                  if( is_finish( head.m_demand ) && head.m_seq != first_seq )
+                     continue;
+
+                  if( lane_ready_at( it->first ) > now )
+                     continue;
+
+                  selected = it;
+               }
+
+            if( selected == m_lanes.end() )
+               return std::nullopt;
+
+            for( auto * b : { selected->first.first, selected->first.second } )
+               if( b )
+                  {
+                     b->refill( now );
+                     b->m_tokens -= 1.0;
+                  }
+
+            return take_head( selected );
+         }
+
+      // Demands are given away in the order of their arrival,
+      // limits aren't checked and tokens aren't consumed.
+      [[nodiscard]]
+      std::optional<so_5::execution_demand_t>
+      extract_for_migration() noexcept override
+         {
+            return take_head( std::min_element(
+                  m_lanes.begin(), m_lanes.end(),
+                  []( const auto & a, const auto & b ) {
+                     return a.second.front().m_seq < b.second.front().m_seq;
+                  } ) );
+         }
+
+      void
+      push( so_5::execution_demand_t demand ) override
+         {
+            const auto key = detect_lane( demand );
+            m_lanes[ key ].push_back( lane_item_t{ m_next_seq, std::move(demand) } );
+            ++m_next_seq;
+            ++m_size;
+         }
+
+      [[nodiscard]]
+      std::optional< clock_t::time_point >
+      ready_at() const noexcept override
+         {
+            const auto first_seq = min_seq();
+
+            std::optional< clock_t::time_point > result;
+            for( const auto & kv : m_lanes )
+               {
+                  const auto & head = kv.second.front();
+                  if( is_finish( head.m_demand ) && head.m_seq != first_seq )
+                     continue;
+
+                  const auto t = lane_ready_at( kv.first );
+                  if( !result || t < *result )
+                     result = t;
+               }
+
+            return result;
+         }
+   };
+
+//
+// receiver_batching_t
+//
+/*!
+ * A queue that handles up to K pending demands for the same receiver
+ * in a row.
+ *
+ * If many agents share the same queue a FIFO interleaves their demands
+ * and every handler call touches the state of another agent. This queue
+ * stores demands in per-receiver FIFO lanes and serves non-empty lanes
+ * in round-robin manner: up to K demands are taken from a lane before
+ * switching to the next one. So the state of an agent stays in caches
+ * for several handler calls in a row.
+ *
+ * Demands for the same receiver are handled in FIFO order. A receiver
+ * waits for at most K * (count of other receivers with pending demands)
+ * demands before its demand is handled.
+ */
+class receiver_batching_t final : public custom_queue_disps::demand_queue_t
+   {
+      using lane_t = std::deque< so_5::execution_demand_t >;
+
+      const std::size_t m_max_batch;
+
+      // NOTE: pointers to lanes are stable because unordered_map
+      // doesn't move its values.
+      std::unordered_map< const so_5::agent_t *, lane_t > m_lanes;
+
+      // Non-empty lanes. The first one is served now, others wait
+      // for their turn.
+      //
+      // NOTE: std::list is used because a lane can be moved to the end
+      // by splice() without allocation, so try_extract() can't throw.
+      std::list< lane_t * > m_ready;
+
+      // The count of demands taken from the first lane in m_ready.
+      std::size_t m_taken{};
+
+      std::size_t m_size{};
+
+   public:
+      explicit receiver_batching_t( std::size_t max_batch = 16u )
+         :  m_max_batch{ max_batch ? max_batch : 1u }
+         {}
+
+      [[nodiscard]]
+      bool
+      empty() const noexcept override { return 0u == m_size; }
+
+      [[nodiscard]]
+      std::size_t
+      size() const noexcept override { return m_size; }
+
+      [[nodiscard]]
+      std::optional<so_5::execution_demand_t>
+      try_extract() noexcept override
+         {
+            if( m_taken == m_max_batch )
+               {
+                  // The current lane has used its turn.
+                  m_ready.splice( m_ready.end(), m_ready, m_ready.begin() );
+                  m_taken = 0u;
+               }
+
+            auto & lane = *m_ready.front();
+            std::optional<so_5::execution_demand_t> result{
+               std::move(lane.front())
+            };
+            lane.pop_front();
+            ++m_taken;
+            --m_size;
+
+            if( lane.empty() )
+               {
+                  m_ready.pop_front();
+                  m_taken = 0u;
+
+                  if( so_5::agent_t::get_demand_handler_on_finish_ptr()
+                        == result->m_demand_handler )
+                     // There won't be demands for that agent anymore.
+                     m_lanes.erase( result->m_receiver );
+               }
+
+            return result;
+         }
+
+      void
+      push( so_5::execution_demand_t demand ) override
+         {
+            auto & lane = m_lanes[ demand.m_receiver ];
+            const bool lane_was_empty = lane.empty();
+
+            lane.push_back( std::move(demand) );
+            if( lane_was_empty )
+               {
+                  try
+                     {
+                        m_ready.push_back( &lane );
+                     }
+                  catch( ... )
+                     {
+                        lane.pop_back();
+                        throw;
+                     }
+               }
+            ++m_size;
+         }
+   };
+
+} /* namespace demo */
+
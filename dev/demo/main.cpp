@@ -1,9 +1,9 @@
+#include <demo/demand_queues.hpp>
+
 #include <custom_queue_disps/one_thread.hpp>
 
 #include <so_5/all.hpp>
 
-#include <queue>
-
 namespace demo
 {
 
@@ -13,9 +13,9 @@ namespace demo
 class demo_agent_t final : public so_5::agent_t
    {
    public:
-      struct hello final : public so_5::signal_t {};
-      struct bye final : public so_5::signal_t {};
-      struct complete final : public so_5::signal_t {};
+      using hello = demo::hello;
+      using bye = demo::bye;
+      using complete = demo::complete;
 
       demo_agent_t( context_t ctx, std::string name )
          :  so_5::agent_t{ std::move(ctx) }
@@ -71,247 +71,6 @@ class demo_agent_t final : public so_5::agent_t
          }
    };
 
-//
-// simple_fifo_t
-//
-class simple_fifo_t final : public custom_queue_disps::demand_queue_t
-   {
-      std::queue< so_5::execution_demand_t > m_queue;
-
-   public:
-      simple_fifo_t() = default;
-
-      [[nodiscard]]
-      bool
-      empty() const noexcept override { return m_queue.empty(); }
-
-      [[nodiscard]]
-      std::optional<so_5::execution_demand_t>
-      try_extract() noexcept override
-         {
-            std::optional<so_5::execution_demand_t> result{
-               std::move(m_queue.front())
-            };
-            m_queue.pop();
-
-            return result;
-         }
-
-      void
-      push( so_5::execution_demand_t demand ) override
-         {
-            m_queue.push( std::move(demand) );
-         }
-   };
-
-//
-// hardcoded_priorities_t
-//
-class hardcoded_priorities_t final : public custom_queue_disps::demand_queue_t
-   {
-      using priority_t = std::uint_fast8_t;
-
-      static constexpr priority_t lowest{ 0u };
-      static constexpr priority_t low{ 1u };
-      static constexpr priority_t normal{ 2u };
-      static constexpr priority_t high{ 3u };
-      static constexpr priority_t highest{ 4u };
-
-      [[nodiscard]]
-      static priority_t
-      detect_priority( const so_5::execution_demand_t & d ) noexcept
-         {
-            if( so_5::agent_t::get_demand_handler_on_start_ptr()
-                  == d.m_demand_handler )
-               return highest;
-
-            if( so_5::agent_t::get_demand_handler_on_finish_ptr()
-                  == d.m_demand_handler )
-               return lowest;
-
-            if( std::type_index{ typeid(demo_agent_t::bye) } == d.m_msg_type )
-               return high;
-
-            if( std::type_index{ typeid(demo_agent_t::hello) } == d.m_msg_type )
-               return low;
-
-            return normal;
-         }
-
-      struct actual_demand_t
-         {
-            so_5::execution_demand_t m_demand;
-            priority_t m_priority;
-
-            actual_demand_t(
-               so_5::execution_demand_t demand,
-               priority_t priority )
-               :  m_demand{ std::move(demand) }
-               ,  m_priority{ priority }
-               {}
-
-            [[nodiscard]]
-            bool
-            operator<( const actual_demand_t & o ) const noexcept
-               {
-                  return m_priority < o.m_priority;
-               }
-         };
-
-      std::priority_queue< actual_demand_t > m_queue;
-
-   public:
-      hardcoded_priorities_t() = default;
-
-      [[nodiscard]]
-      bool
-      empty() const noexcept override { return m_queue.empty(); }
-
-      [[nodiscard]]
-      std::optional<so_5::execution_demand_t>
-      try_extract() noexcept override
-         {
-            std::optional<so_5::execution_demand_t> result{
-               m_queue.top().m_demand
-            };
-            m_queue.pop();
-
-            return result;
-         }
-
-      void
-      push( so_5::execution_demand_t demand ) override
-         {
-            const auto prio = detect_priority( demand );
-            m_queue.emplace( std::move(demand), prio );
-         }
-   };
-
-//
-// dynamic_per_agent_priorities_t
-//
-
-class dynamic_per_agent_priorities_t final
-   : public custom_queue_disps::demand_queue_t
-   {
-   public:
-      using priority_t = std::uint_fast8_t;
-
-      static constexpr priority_t lowest{ 0u };
-      static constexpr priority_t low{ 1u };
-      static constexpr priority_t normal{ 2u };
-      static constexpr priority_t high{ 3u };
-      static constexpr priority_t highest{ 4u };
-
-   private:
-      // Type of map from message to a priority.
-      using type_to_prio_map_t = std::map< std::type_index, priority_t >;
-
-      // Type of map from agent's pointer to a map of message priorities.
-      using agent_to_prio_map_t =
-            std::map< so_5::agent_t *, type_to_prio_map_t >;
-
-      // Type of demand to be stored in the priority queue.
-      struct actual_demand_t
-         {
-            so_5::execution_demand_t m_demand;
-            priority_t m_priority;
-
-            actual_demand_t(
-               so_5::execution_demand_t demand,
-               priority_t priority )
-               :  m_demand{ std::move(demand) }
-               ,  m_priority{ priority }
-               {}
-
-            [[nodiscard]]
-            bool
-            operator<( const actual_demand_t & o ) const noexcept
-               {
-                  return m_priority < o.m_priority;
-               }
-         };
-
-      // The lock for priorities map.
-      std::mutex m_prio_map_lock;
-      // Container of agent's priorities.
-      agent_to_prio_map_t m_agent_prios;
-
-      // Queue of pending priorities.
-      std::priority_queue< actual_demand_t > m_queue;
-
-      // Not only detects a priority but also removes priorities
-      // for an agent if `d` is the final demand for that agent.
-      [[nodiscard]]
-      priority_t
-      handle_new_demand_priority( const so_5::execution_demand_t & d ) noexcept
-         {
-            if( so_5::agent_t::get_demand_handler_on_start_ptr()
-                  == d.m_demand_handler )
-               return highest;
-
-            if( so_5::agent_t::get_demand_handler_on_finish_ptr()
-                  == d.m_demand_handler )
-               {
-                  // There is no more need for priorities for that agent.
-                  std::lock_guard< std::mutex > lock{ m_prio_map_lock };
-                  m_agent_prios.erase( d.m_receiver );
-                  return lowest;
-               }
-
-            {
-               // We have to search priority for the message for that agent.
-               std::lock_guard< std::mutex > lock{ m_prio_map_lock };
-               auto it_agent = m_agent_prios.find( d.m_receiver );
-               if( it_agent != m_agent_prios.end() )
-                  {
-                     auto it_msg = it_agent->second.find( d.m_msg_type );
-                     if( it_msg != it_agent->second.end() )
-                        return it_msg->second;
-                  }
-            }
-
-            return normal;
-         }
-
-   public:
-      dynamic_per_agent_priorities_t() = default;
-
-      void
-      define_priority(
-         so_5::agent_t * receiver,
-         std::type_index msg_type,
-         priority_t priority )
-         {
-            std::lock_guard< std::mutex > lock{ m_prio_map_lock };
-
-            m_agent_prios[ receiver ][ msg_type ] = priority;
-         }
-
-      [[nodiscard]]
-      bool
-      empty() const noexcept override { return m_queue.empty(); }
-
-      [[nodiscard]]
-      std::optional<so_5::execution_demand_t>
-      try_extract() noexcept override
-         {
-            std::optional<so_5::execution_demand_t> result{
-               m_queue.top().m_demand
-            };
-            m_queue.pop();
-
-            return result;
-         }
-
-      void
-      push( so_5::execution_demand_t demand ) override
-         {
-            const auto prio = handle_new_demand_priority( demand );
-            m_queue.emplace( std::move(demand), prio );
-         }
-   };
-
 void
 demo_with_simple_fifo()
    {
@@ -0,0 +1,111 @@
+/*
+ * A test for one_thread dispatcher with the thread priority.
+ *
+ * make_dispatcher() has to throw for an invalid priority and must not
+ * hang. A valid priority can be rejected by the OS if the process has
+ * no rights for SCHED_RR. make_dispatcher() has to throw in that case
+ * too. Otherwise the dispatcher has to be created and destroyed.
+ *
+ * The priority is ignored on platforms other than Linux, so
+ * make_dispatcher() never throws there.
+ */
+
+#include <custom_queue_disps/one_thread.hpp>
+
+#include <so_5/all.hpp>
+
+#include <chrono>
+#include <cstdlib>
+#include <future>
+#include <iostream>
+#include <system_error>
+
+namespace test
+{
+
+namespace cqd = custom_queue_disps::one_thread;
+
+enum class outcome_t { created, thrown };
+
+[[nodiscard]]
+outcome_t
+try_make_dispatcher( so_5::environment_t & env, int priority )
+   {
+      // make_dispatcher() is called on a separate thread because
+      // a hang has to be detected.
+      auto result = std::async( std::launch::async, [&env, priority] {
+            try
+               {
+                  auto disp = cqd::make_dispatcher(
+                        env, cqd::disp_params_t{}.thread_priority( priority ) );
+                  disp.reset();
+                  return outcome_t::created;
+               }
+            catch( const std::system_error & x )
+               {
+                  std::cout << "priority " << priority << ": " << x.what()
+                        << std::endl;
+                  return outcome_t::thrown;
+               }
+         } );
+
+      if( std::future_status::ready !=
+            result.wait_for( std::chrono::seconds{ 10 } ) )
+         {
+            std::cerr << "priority " << priority << ": make_dispatcher() hangs"
+                  << std::endl;
+            // The destructor of the future would wait for the hanging thread.
+            std::_Exit( 1 );
+         }
+
+      return result.get();
+   }
+
+} /* namespace test */
+
+int
+main()
+   {
+      using namespace test;
+
+      try
+         {
+            so_5::wrapped_env_t sobj;
+            auto & env = sobj.environment();
+
+            int failures{};
+            const auto check = [&failures]( bool ok, const char * what ) {
+                  if( !ok )
+                     {
+                        std::cerr << "FAILED: " << what << std::endl;
+                        ++failures;
+                     }
+               };
+
+#if defined(__linux__)
+            check( outcome_t::thrown == try_make_dispatcher( env, 1000 ),
+                  "priority 1000 has to be rejected" );
+            check( outcome_t::thrown == try_make_dispatcher( env, 0 ),
+                  "priority 0 has to be rejected" );
+#else
+            check( outcome_t::created == try_make_dispatcher( env, 1000 ),
+                  "priority has to be ignored" );
+#endif
+            // It depends on the rights of the process, but it must
+            // not hang in any case.
+            (void)try_make_dispatcher( env, 1 );
+
+            sobj.stop_then_join();
+
+            if( failures )
+               return 1;
+         }
+      catch( const std::exception & x )
+         {
+            std::cerr << "Exception caught: " << x.what() << std::endl;
+            return 2;
+         }
+
+      std::cout << "OK" << std::endl;
+      return 0;
+   }
@@ -0,0 +1,525 @@
+/*
+ * A tool for replaying of a demand trace recorded by
+ * custom_queue_disps::trace::recorder_t.
+ *
+ * The tool simulates the work of one_thread dispatcher with a
+ * specified queue policy. Simulation uses virtual time: demands are
+ * pushed to demand queues at recorded moments and synthetic handlers
+ * take exactly the recorded time. Because of that the replay is
+ * deterministic and doesn't depend on the speed of the machine.
+ *
+ * Usage:
+ *
+ *    trace_replay <trace-file> [<policy>...]
+ *
+ * If no policy is specified then all known policies are used.
+ */
+
+#include <demo/demand_queues.hpp>
+
+#include <custom_queue_disps/trace.hpp>
+
+#include <so_5/all.hpp>
+
+#include <algorithm>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <utility>
+
+#if defined(__GNUC__)
+   #include <cxxabi.h>
+#endif
+
+namespace trace_replay
+{
+
+namespace trace = custom_queue_disps::trace;
+
+//
+// replayed_demand_t
+//
+/*!
+ * Description of a demand restored from a trace.
+ */
+struct replayed_demand_t
+   {
+      std::uint64_t m_enqueued_at;
+      std::uint64_t m_queue_id;
+      std::uint64_t m_receiver_id;
+      std::uint32_t m_msg_type_id;
+      trace::demand_kind_t m_demand_kind;
+      //! Zero if there is no information about the handler in the trace.
+      std::uint64_t m_duration{};
+   };
+
+//
+// loaded_trace_t
+//
+struct loaded_trace_t
+   {
+      //! Demands in the order of arrival.
+      std::vector< replayed_demand_t > m_demands;
+
+      std::vector< std::string > m_type_names;
+
+      //! Latencies seen in the trace itself.
+      std::vector< std::uint64_t > m_recorded_latencies;
+   };
+
+/*!
+ * Loads a trace and matches enqueued, dequeued and handled events.
+ *
+ * There are no demand's IDs in a trace, so events are matched
+ * by receiver and message type in FIFO order. It's exact for FIFO
+ * queues and is good approximation for other policies.
+ */
+[[nodiscard]]
+loaded_trace_t
+load_trace( const std::string & file_name )
+   {
+      using key_t = std::pair< std::uint64_t, std::uint32_t >;
+      using pending_map_t = std::map< key_t, std::deque< std::size_t > >;
+
+      loaded_trace_t result;
+
+      pending_map_t not_dequeued;
+      pending_map_t not_handled;
+
+      trace::reader_t reader{ file_name };
+      while( auto r = reader.next() )
+         {
+            const key_t key{ r->m_receiver_id, r->m_msg_type_id };
+            switch( r->m_event )
+               {
+               case trace::event_t::enqueued:
+                  not_dequeued[ key ].push_back( result.m_demands.size() );
+                  not_handled[ key ].push_back( result.m_demands.size() );
+                  result.m_demands.push_back( replayed_demand_t{
+                        r->m_timestamp,
+                        r->m_queue_id,
+                        r->m_receiver_id,
+                        r->m_msg_type_id,
+                        r->m_demand_kind } );
+               break;
+
+               case trace::event_t::dequeued:
+                  if( auto & q = not_dequeued[ key ]; !q.empty() )
+                     {
+                        const auto & d = result.m_demands[ q.front() ];
+                        result.m_recorded_latencies.push_back(
+                              r->m_timestamp - d.m_enqueued_at );
+                        q.pop_front();
+                     }
+               break;
+
+               case trace::event_t::handled:
+                  if( auto & q = not_handled[ key ]; !q.empty() )
+                     {
+                        result.m_demands[ q.front() ].m_duration =
+                              r->m_duration;
+                        q.pop_front();
+                     }
+               break;
+
+               default:
+               break;
+               }
+         }
+
+      for( std::size_t i = 0u; i != reader.type_count(); ++i )
+         result.m_type_names.push_back(
+               reader.type_name( static_cast< std::uint32_t >(i) ) );
+
+      return result;
+   }
+
+[[nodiscard]]
+std::string
+demangle( const std::string & name )
+   {
+#if defined(__GNUC__)
+      int status{};
+      std::unique_ptr< char, void(*)(void*) > r{
+            abi::__cxa_demangle( name.c_str(), nullptr, nullptr, &status ),
+            std::free
+      };
+      if( 0 == status && r )
+         return r.get();
+#endif
+      return name;
+   }
+
+//
+// Message types for synthetic demands.
+//
+
+template< std::size_t N >
+struct synthetic_type_t final : public so_5::signal_t {};
+
+template< std::size_t... Is >
+[[nodiscard]]
+std::vector< std::type_index >
+make_synthetic_types( std::index_sequence< Is... > )
+   {
+      return { std::type_index{ typeid(synthetic_type_t< Is >) }... };
+   }
+
+/*!
+ * Maps message types from a trace to types that are visible for
+ * queue policies.
+ *
+ * Types known by the demo queues (like demo::hello) are mapped to
+ * themselves. Unknown types are replaced by synthetic ones.
+ */
+[[nodiscard]]
+std::vector< std::type_index >
+map_message_types( const std::vector< std::string > & names )
+   {
+      static const std::type_index known_types[] = {
+            typeid(demo::hello),
+            typeid(demo::bye),
+            typeid(demo::complete)
+         };
+      static const auto synthetic_types =
+            make_synthetic_types( std::make_index_sequence< 64 >{} );
+
+      std::vector< std::type_index > result;
+      for( const auto & n : names )
+         {
+            const auto it = std::find_if(
+                  std::begin(known_types), std::end(known_types),
+                  [&n]( const std::type_index & t ) { return n == t.name(); } );
+            if( it != std::end(known_types) )
+               result.push_back( *it );
+            else if( result.size() < synthetic_types.size() )
+               result.push_back( synthetic_types[ result.size() ] );
+            else
+               throw std::runtime_error( "too many message types in trace" );
+         }
+
+      return result;
+   }
+
+//
+// simulation_t
+//
+/*!
+ * Simulation of one_thread dispatcher in virtual time.
+ */
+class simulation_t
+   {
+      //! Message that is used for synthetic demands.
+      struct replayed_message_t final : public so_5::message_t
+         {
+            simulation_t & m_owner;
+            const std::size_t m_index;
+
+            replayed_message_t( simulation_t & owner, std::size_t index )
+               :  m_owner{ owner }
+               ,  m_index{ index }
+               {}
+         };
+
+      const loaded_trace_t & m_trace;
+      const std::vector< std::type_index > m_msg_types;
+
+      //! The current virtual time.
+      std::uint64_t m_now{};
+
+      //! Latency for every demand. Empty if demand wasn't handled.
+      std::vector< std::optional< std::uint64_t > > m_latencies;
+
+      std::size_t m_rejected{};
+      std::size_t m_not_extracted{};
+
+      static void
+      synthetic_handler(
+         so_5::current_thread_id_t,
+         so_5::execution_demand_t & d )
+         {
+            auto & msg = static_cast< replayed_message_t & >(
+                  *d.m_message_ref );
+            msg.m_owner.on_handler( msg.m_index );
+         }
+
+      /*!
+       * Returns the handler that is seen by queue policies.
+       *
+       * @note
+       * Demands for evt_start and evt_finish get the real handlers
+       * of SObjectizer because policies detect them by those pointers.
+       * But such handlers can't be called because there is no real
+       * agent. See handle().
+       */
+      [[nodiscard]]
+      static so_5::demand_handler_pfn_t
+      handler_for( trace::demand_kind_t kind ) noexcept
+         {
+            switch( kind )
+               {
+               case trace::demand_kind_t::start:
+                  return so_5::agent_t::get_demand_handler_on_start_ptr();
+
+               case trace::demand_kind_t::finish:
+                  return so_5::agent_t::get_demand_handler_on_finish_ptr();
+
+               default:
+                  return &synthetic_handler;
+               }
+         }
+
+      void
+      handle(
+         so_5::current_thread_id_t thread_id,
+         so_5::execution_demand_t & d )
+         {
+            if( &synthetic_handler == d.m_demand_handler )
+               d.call_handler( thread_id );
+            else
+               on_handler( static_cast< replayed_message_t & >(
+                     *d.m_message_ref ).m_index );
+         }
+
+      void
+      on_handler( std::size_t index )
+         {
+            const auto & d = m_trace.m_demands[ index ];
+            m_latencies[ index ] = m_now - d.m_enqueued_at;
+            // Synthetic handler takes the recorded time.
+            m_now += d.m_duration;
+         }
+
+      [[nodiscard]]
+      so_5::execution_demand_t
+      make_demand( std::size_t index )
+         {
+            const auto & d = m_trace.m_demands[ index ];
+            return {
+                  // Receiver is used only as a key by queue policies.
+                  // It's never dereferenced.
+                  reinterpret_cast< so_5::agent_t * >(
+                        static_cast< std::uintptr_t >( d.m_receiver_id + 1u ) ),
+                  nullptr,
+                  0u,
+                  m_msg_types[ d.m_msg_type_id ],
+                  so_5::message_ref_t{
+                        std::make_unique< replayed_message_t >( *this, index )
+                  },
+                  handler_for( d.m_demand_kind )
+               };
+         }
+
+   public:
+      simulation_t( const loaded_trace_t & trace )
+         :  m_trace{ trace }
+         ,  m_msg_types{ map_message_types( trace.m_type_names ) }
+         ,  m_latencies( trace.m_demands.size() )
+         {}
+
+      void
+      run( const std::function< custom_queue_disps::demand_queue_shptr_t() > & factory )
+         {
+            const auto thread_id = so_5::query_current_thread_id();
+            const auto & demands = m_trace.m_demands;
+
+            std::map< std::uint64_t, custom_queue_disps::demand_queue_shptr_t >
+                  queues;
+            // The list of non-empty queues.
+            std::deque< custom_queue_disps::demand_queue_t * > active;
+            // Count of extraction attempts without results in a row.
+            std::size_t idle_attempts{};
+
+            std::size_t next{};
+            while( next != demands.size() || !active.empty() )
+               {
+                  for( ; next != demands.size() &&
+                        demands[ next ].m_enqueued_at <= m_now; ++next )
+                     {
+                        auto & q = queues[ demands[ next ].m_queue_id ];
+                        if( !q )
+                           q = factory();
+
+                        const bool queue_was_empty = q->empty();
+                        try
+                           {
+                              q->push( make_demand( next ) );
+                           }
+                        catch( const std::exception & )
+                           {
+                              ++m_rejected;
+                           }
+                        if( queue_was_empty && !q->empty() )
+                           active.push_back( q.get() );
+                     }
+
+                  if( active.empty() || idle_attempts > active.size() )
+                     {
+                        // Nothing can be done until the next arrival.
+                        if( next == demands.size() )
+                           break;
+
+                        m_now = std::max( m_now, demands[ next ].m_enqueued_at );
+                        idle_attempts = 0u;
+                        continue;
+                     }
+
+                  auto * q = active.front();
+                  active.pop_front();
+
+                  auto demand = q->try_extract();
+                  if( !q->empty() )
+                     active.push_back( q );
+
+                  if( demand )
+                     {
+                        idle_attempts = 0u;
+                        handle( thread_id, *demand );
+                     }
+                  else
+                     {
+                        ++idle_attempts;
+                        ++m_not_extracted;
+                     }
+               }
+         }
+
+      [[nodiscard]]
+      const std::vector< std::optional< std::uint64_t > > &
+      latencies() const noexcept { return m_latencies; }
+
+      [[nodiscard]]
+      std::size_t
+      rejected() const noexcept { return m_rejected; }
+
+      [[nodiscard]]
+      std::size_t
+      not_extracted() const noexcept { return m_not_extracted; }
+   };
+
+void
+print_distribution(
+   const std::string & title,
+   std::vector< std::uint64_t > values )
+   {
+      std::cout << "  " << std::left << std::setw( 32 ) << title
+            << std::right;
+      if( values.empty() )
+         {
+            std::cout << " no data" << std::endl;
+            return;
+         }
+
+      std::sort( values.begin(), values.end() );
+      const auto percentile = [&values]( double p ) {
+            return static_cast< double >( values[
+                  static_cast< std::size_t >( p * (values.size() - 1u) ) ] )
+                  / 1000.0;
+         };
+
+      std::cout << std::fixed << std::setprecision( 1 )
+            << " count=" << values.size()
+            << " p50=" << percentile( 0.5 ) << "us"
+            << " p90=" << percentile( 0.9 ) << "us"
+            << " p99=" << percentile( 0.99 ) << "us"
+            << " p99.9=" << percentile( 0.999 ) << "us"
+            << " max=" << percentile( 1.0 ) << "us"
+            << std::endl;
+   }
+
+void
+replay(
+   const loaded_trace_t & trace,
+   const std::string & policy_name,
+   const std::function< custom_queue_disps::demand_queue_shptr_t() > & factory )
+   {
+      simulation_t sim{ trace };
+      sim.run( factory );
+
+      std::vector< std::uint64_t > all;
+      std::map< std::uint32_t, std::vector< std::uint64_t > > by_type;
+      for( std::size_t i = 0u; i != sim.latencies().size(); ++i )
+         if( const auto & l = sim.latencies()[ i ]; l )
+            {
+               all.push_back( *l );
+               by_type[ trace.m_demands[ i ].m_msg_type_id ].push_back( *l );
+            }
+
+      std::cout << "=== " << policy_name << " ===" << std::endl;
+      std::cout << "  demands: " << trace.m_demands.size()
+            << ", handled: " << all.size()
+            << ", rejected: " << sim.rejected()
+            << ", empty extractions: " << sim.not_extracted() << std::endl;
+      print_distribution( "latency", std::move(all) );
+      for( auto & [type_id, values] : by_type )
+         print_distribution(
+               demangle( trace.m_type_names[ type_id ] ),
+               std::move(values) );
+   }
+
+} /* namespace trace_replay */
+
+int main( int argc, char ** argv )
+   {
+      using namespace trace_replay;
+
+      const std::map<
+            std::string,
+            std::function< custom_queue_disps::demand_queue_shptr_t() > >
+         policies{
+            { "simple_fifo",
+               []{ return std::make_shared< demo::simple_fifo_t >(); } },
+            { "hardcoded_priorities",
+               []{ return std::make_shared< demo::hardcoded_priorities_t >(); } },
+            { "dynamic_per_agent_priorities",
+               []{ return std::make_shared< demo::dynamic_per_agent_priorities_t >(); } },
+            // NOTE: limits of rate_limited_t are based on the real clock
+            // and can't be used in the replay with virtual time.
+            // So the queue is used without limits here.
+            { "rate_limited",
+               []{ return std::make_shared< demo::rate_limited_t >(); } },
+            { "receiver_batching",
+               []{ return std::make_shared< demo::receiver_batching_t >(); } }
+         };
+
+      if( argc < 2 )
+         {
+            std::cerr << "Usage: " << argv[ 0 ] << " <trace-file> [<policy>...]"
+                  << std::endl << "Known policies:" << std::endl;
+            for( const auto & p : policies )
+               std::cerr << "  " << p.first << std::endl;
+            return 2;
+         }
+
+      try
+         {
+            const auto trace = load_trace( argv[ 1 ] );
+
+            std::cout << "=== recorded ===" << std::endl;
+            print_distribution( "latency", trace.m_recorded_latencies );
+
+            if( argc == 2 )
+               for( const auto & p : policies )
+                  replay( trace, p.first, p.second );
+            else
+               for( int i = 2; i < argc; ++i )
+                  {
+                     const auto it = policies.find( argv[ i ] );
+                     if( it == policies.end() )
+                        throw std::runtime_error(
+                              std::string{ "unknown policy: " } + argv[ i ] );
+                     replay( trace, it->first, it->second );
+                  }
+         }
+      catch( const std::exception & x )
+         {
+            std::cerr << "*** Exception caught: " << x.what() << std::endl;
+            return 1;
+         }
+
+      return 0;
+   }
+
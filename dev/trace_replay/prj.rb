@@ -0,0 +1,11 @@
+require 'mxx_ru/cpp'
+
+MxxRu::Cpp::exe_target {
+
+  target 'trace_replay'
+
+  required_prj 'custom_queue_disps/prj.rb'
+  required_prj 'so_5/prj_s.rb'
+
+  cpp_source 'main.cpp'
+}